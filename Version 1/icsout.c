@@ -1,461 +1,1380 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <errno.h>
 
 #define MAX_LINE_LEN 132
-#define MAX_EVENTS 500
+#define MIN_CAPACITY 64
+#define MIN_SLOTS 64
+#define OUTPUT_LEN (64 * 1024)
+#define SECS_PER_DAY 86400
+#define NO_RRULE INT32_MIN
+#define RADIX_BITS 11
+#define RADIX_SIZE (1 << RADIX_BITS)
 
 typedef struct event{
-    char *dtstart;
-    char *dtend;
-    char *start_time;
-    char *end_time;
-    char *repeat_until;
-    char *location;
-    char *summary;
-    char output[MAX_LINE_LEN];
+    int64_t start;
+    int64_t end;
+    int32_t until;
+    uint32_t location;
+    uint32_t summary;
 } Event;
 
+typedef struct span{
+    const char *ptr;
+    size_t len;
+} Span;
+
+typedef struct strings{
+    char **str;
+    uint32_t *hash;
+    uint32_t count;
+    uint32_t cap;
+    uint32_t *slot;
+    uint32_t nslots;
+} Strings;
+
+enum phase{ PARSE, EXPAND, SORT, PRINT, NUM_PHASES };
+
+typedef struct stopwatch{
+    double wall;
+    double cpu;
+} Stopwatch;
+
+typedef struct stats{
+    double wall[NUM_PHASES];
+    double cpu[NUM_PHASES];
+    Stopwatch lap;
+    uint64_t lines;
+    uint64_t bytes;
+    uint64_t vevents;
+    uint64_t generated;
+    uint64_t emitted;
+    uint64_t allocations;
+} Stats;
+
+typedef struct calendar{
+    Event *events;
+    int size;
+    int capacity;
+    Strings strings;
+    Stats *stats;
+} Calendar;
+
+typedef struct input{
+    char *base;
+    size_t size;
+    size_t pos;
+    size_t lines;
+    FILE *stream;
+    char *line;
+    size_t line_cap;
+} Input;
+
+typedef struct output{
+    int fd;
+    size_t len;
+    char buf[OUTPUT_LEN];
+} Output;
+
+typedef struct header{
+    char *text;
+    int len;
+} Header;
+
+typedef struct headers{
+    int from;
+    int count;
+    Header *days;
+} Headers;
+
+enum field{ DTSTART, DTEND, RRULE, LOCATION, SUMMARY, NUM_FIELDS };
+
+static uint64_t heap_blocks;    /* asked of malloc() and calloc(), for --stats */
+
 
-void extract(char *, int, int);
-void sort_and_print(Event c[], int, int, int);
-void print_date(char *, const char *, const int);
-void print_line(char *);
-void print_time_summary(int, int, char *, char *);
-void increment_date(char *, const char *, int const);
-void decrement_date(char *, const char *, int const);
-int concatenate(int, int, int);
+void extract_path(Calendar *, const char *);
+void extract(Calendar *, const char *);
+void sort_and_print(Calendar *, int, int);
+void sort_events(Calendar *);
+int print_date(char *, int, const int);
+void print_header(Output *, Headers *, int);
+void free_headers(Headers *);
+void print_time_summary(Output *, int, int, char *, char *);
+void format_time(char *, int);
+void out_write(Output *, const char *, size_t);
+void out_flush(Output *);
+int32_t days_from_civil(int, int, int);
+void civil_from_days(int32_t, int *, int *, int *);
+int weekday(int32_t);
+int64_t parse_datetime(Span);
+int32_t day_of(int64_t);
+Event *add_event(Calendar *);
+int open_input(Input *, const char *);
+void close_input(Input *);
+int next_property(Input *, Span *, Span *);
+Span hold_span(char **, size_t *, Span);
+int span_is(Span, const char *);
+char *copy_span(Span);
+void *count_malloc(size_t);
+void *count_calloc(size_t, size_t);
+uint32_t intern(Strings *, Span);
+uint32_t hash_span(Span);
+void start_stopwatch(Stopwatch *);
+void lap(Stats *, int);
+void print_stats(FILE *, const Stats *, int);
 
+#ifndef SORT_BENCH
 int main(int argc, char *argv[]){
 
     int from_y = 0, from_m = 0, from_d = 0;
     int to_y = 0, to_m = 0, to_d = 0;
-    char *filename = NULL;
+    char **files = count_malloc(argc * sizeof(char *));
+    int nfiles = 0, stats_format = 0;
     int i; 
 
-    for (i = 0; i < argc; i++) {
+    if (files == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    /* --file= may be repeated and may name a directory; arguments after
+     * the first --file= that are not options are more files, so that a
+     * shell glob works. --stats writes the time of each step and what it
+     * made to stderr, --stats=json the same as one line of JSON */
+    for (i = 1; i < argc; i++) {
         if (strncmp(argv[i], "--start=", 8) == 0) {
             sscanf(argv[i], "--start=%d/%d/%d", &from_y, &from_m, &from_d);
         } else if (strncmp(argv[i], "--end=", 6) == 0) {
             sscanf(argv[i], "--end=%d/%d/%d", &to_y, &to_m, &to_d);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats_format = 1;
+        } else if (strcmp(argv[i], "--stats=json") == 0) {
+            stats_format = 2;
         } else if (strncmp(argv[i], "--file=", 7) == 0) {
-            filename = argv[i]+7;
+            files[nfiles++] = argv[i]+7;
+        } else if (nfiles > 0) {
+            files[nfiles++] = argv[i];
         }
     }
 
-    if (from_y == 0 || to_y == 0 || filename == NULL) {
+    if (from_y == 0 || to_y == 0 || nfiles == 0) {
         fprintf(stderr, 
-            "usage: %s --start=yyyy/mm/dd --end=yyyy/mm/dd --file=icsfile\n",
+            "usage: %s --start=yyyy/mm/dd --end=yyyy/mm/dd [--stats[=json]] --file=icsfile|dir ...\n",
             argv[0]);
         exit(1);
     }
 
     /* Starting calling your own code from this point. */
-    int from = concatenate(from_y, from_m, from_d);
-    int to = concatenate(to_y, to_m, to_d);
-    extract(filename, from, to);
+    int from = days_from_civil(from_y, from_m, from_d);
+    int to = days_from_civil(to_y, to_m, to_d);
+    Calendar calendar;
+    Stats stats;
+
+    memset(&calendar, 0, sizeof(Calendar));
+    if (stats_format) {
+        memset(&stats, 0, sizeof(Stats));
+        calendar.stats = &stats;
+        start_stopwatch(&stats.lap);
+    }
+    for (i = 0; i < nfiles; i++) {
+        extract_path(&calendar, files[i]);
+    }
+    if (stats_format) lap(&stats, PARSE);
+    sort_and_print(&calendar, from, to);
+    if (stats_format) {
+        stats.allocations = heap_blocks;
+        print_stats(stderr, &stats, stats_format == 2);
+    }
+    free(files);
     exit(0);    
 }
+#endif
+
+
+/*
+ * Function: extract_path()
+ *
+ * Purpose: Adds the events of a calendar to a Calendar with extract(),
+ *          or if the path is a directory, those of every .ics file in it
+ *          in order by name. Events from all the files end up in the one
+ *          Calendar, so a single sort puts them all in order.
+ *
+ * Parameters: Calendar *calendar - Calendar to add the events to
+ *             const char *path - a file, "-" for stdin, or a directory
+ */
+
+void extract_path(Calendar *calendar, const char *path){
+
+    struct stat sb;
+    struct dirent **names;
+    char *file;
+    size_t len;
+    int n;
+
+    if(strcmp(path, "-") == 0 || stat(path, &sb) != 0 || !S_ISDIR(sb.st_mode)){
+        extract(calendar, path);
+        return;
+    }
+
+    n = scandir(path, &names, NULL, alphasort);
+    if(n < 0){
+        fprintf(stderr, "unable to read directory %s\n", path);
+        exit(1);
+    }
+    for(int i = 0; i < n; i++){
+        len = strlen(names[i]->d_name);
+        if(len > 4 && strcmp(names[i]->d_name + len - 4, ".ics") == 0){
+            file = count_malloc(strlen(path) + len + 2);
+            if(file == NULL){
+                perror("malloc");
+                exit(1);
+            }
+            sprintf(file, "%s/%s", path, names[i]->d_name);
+            extract(calendar, file);
+            free(file);
+        }
+        free(names[i]);
+    }
+    free(names);
+}
 
 
 /*
  * Function: extract()
  * 
- * Purpose: Reads data from a file and stores it in an array called "words[][]".
- *          Iterates through words[][], and extracts useful information onto an
- *          array of Events called calendar[].
+ * Purpose: Walks the input one property at a time and adds each VEVENT
+ *          onto a Calendar that grows as needed. When the input is a
+ *          mapped file the values of the current VEVENT are kept as views
+ *          into the mapping; when it is a stream ("-" for stdin) they are
+ *          held in small reusable buffers, so only one event's worth of
+ *          raw input is ever kept. Values are copied onto the Calendar
+ *          once the END:VEVENT line is reached, with summaries and
+ *          locations interned so that each distinct string is kept once.
  * 
- * Parameters: char *filename - name of file
- *             int print_from - user specified start date for output
- *             int print_to - user specified end date for output
+ * Parameters: Calendar *calendar - Calendar to add the events to
+ *             const char *filename - name of file, or "-" for stdin
  */
 
-void extract(char *filename, int print_from, int print_to){
+void extract(Calendar *calendar, const char *filename){
 
-    Event calendar[MAX_EVENTS];
-    char words[(MAX_EVENTS*7)][MAX_LINE_LEN];
-    char buffer[MAX_LINE_LEN];
-    char *token, *st, *et, *rt;
+    Input in;
+    Span name, value;
+    Span field[NUM_FIELDS];
+    char *held[NUM_FIELDS] = {NULL};
+    size_t held_cap[NUM_FIELDS] = {0};
+    const char *t;
+    int f, parsed = calendar->size;
 
-    int num_words = 0;
-    int size = 0;
-    
-    FILE *fptr = fopen(filename, "r");
-    if(fptr == NULL){
+    if(open_input(&in, filename) != 0){
         fprintf(stderr, "unable to open %s\n", filename);
+        exit(1);
     }
-    
-    while(fgets(buffer, MAX_LINE_LEN, fptr) != NULL){
-        token = strtok(buffer, ":");
-        while(token != NULL){
-            strncpy(words[num_words], token, 80);
-            num_words++;
-            token = strtok(NULL, "\0");
-        }
-    }
-    
-    for(int i = 0; i < 2 * num_words; i++){
-        if(strcmp(words[i], "DTSTART") == 0){
-            st = strtok(words[i+1], "T");
-            calendar[size].dtstart = st;
-            strncpy(calendar[size].output, calendar[size].dtstart, MAX_LINE_LEN);
-            st = strtok(NULL, "\n");
-            calendar[size].start_time = st;            
-        }
-        if(strcmp(words[i], "DTEND") == 0){
-            et = strtok(words[i+1], "T");
-            calendar[size].dtend = et;
-            et = strtok(NULL, "\n");
-            calendar[size].end_time = et;
-        }
-        if(strcmp(words[i], "RRULE") == 0){
-            rt = strtok(words[i+1], "N");
-            rt = strtok(NULL, "=");
-            rt = strtok(NULL, "T");
-            calendar[size].repeat_until = rt;
-        }
-        if(strcmp(words[i], "LOCATION") == 0){
-            calendar[size].location = words[i+1];
-            calendar[size].location[strcspn(calendar[size].location, "\n")] = 0;
-        }
-        if(strcmp(words[i], "SUMMARY") == 0){
-            calendar[size].summary = words[i+1];
-            calendar[size].summary[strcspn(calendar[size].summary, "\n")] = 0;
-        }
-        if(strcmp(words[i], "END") == 0){
-            if(strcmp(words[i+1], "VEVENT\n") == 0){
-            size++;
+
+    memset(field, 0, sizeof(field));
+    while(next_property(&in, &name, &value)){
+        if(span_is(name, "BEGIN") && span_is(value, "VEVENT")){
+            memset(field, 0, sizeof(field));
+            continue;
+        }
+        if(span_is(name, "END") && span_is(value, "VEVENT")){
+            Event *e = add_event(calendar);
+            e->start = parse_datetime(field[DTSTART]);
+            e->end = parse_datetime(field[DTEND]);
+            e->until = NO_RRULE;
+            if(field[RRULE].len != 0 &&
+               (t = memmem(field[RRULE].ptr, field[RRULE].len, "UNTIL=", 6)) != NULL){
+                e->until = day_of(parse_datetime(
+                    (Span){t + 6, field[RRULE].ptr + field[RRULE].len - t - 6}));
             }
+            e->location = intern(&calendar->strings, field[LOCATION]);
+            e->summary = intern(&calendar->strings, field[SUMMARY]);
+            continue;
         }
+        if(span_is(name, "DTSTART")) f = DTSTART;
+        else if(span_is(name, "DTEND")) f = DTEND;
+        else if(span_is(name, "RRULE")) f = RRULE;
+        else if(span_is(name, "LOCATION")) f = LOCATION;
+        else if(span_is(name, "SUMMARY")) f = SUMMARY;
+        else continue;
+        /* A stream's line buffer is reused, so its values must be held */
+        field[f] = in.stream ? hold_span(&held[f], &held_cap[f], value) : value;
+    }
+    for(f = 0; f < NUM_FIELDS; f++){
+        free(held[f]);
     }
-    sort_and_print(calendar, size, print_from, print_to);
-    fclose(fptr);   
+    if(calendar->stats != NULL){
+        calendar->stats->lines += in.lines;
+        calendar->stats->bytes += in.pos;
+        calendar->stats->vevents += calendar->size - parsed;
+    }
+    close_input(&in);
 }
 
 
-/* 
+/*
+ * Function: add_event()
+ *
+ * Purpose: Appends an empty Event onto a Calendar, doubling its capacity
+ *          whenever it is full so that appends stay cheap on average.
+ *          Pointers into the Calendar are invalidated by this call.
+ *
+ * Parameters: Calendar *cal - calendar to append to
+ *
+ * Returns: Event * - the new, zeroed, Event
+ */
+
+Event *add_event(Calendar *cal){
+
+    Event *e;
+
+    if(cal->size == cal->capacity){
+        int capacity = cal->capacity ? cal->capacity * 2 : MIN_CAPACITY;
+        Event *events = realloc(cal->events, capacity * sizeof(Event));
+        if(events == NULL){
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        cal->events = events;
+        cal->capacity = capacity;
+    }
+    e = &cal->events[cal->size++];
+    memset(e, 0, sizeof(Event));
+    return e;
+}
+
+
+/*
  * Function: sort_and_print()
- * 
- * Purpose: Iterates through an array of Events, adds any repeating events
- *          to the array, sorts the array chronologically by their start dates
- *          or start times, and prints the contents of the array
- *          within the user specified date range in a readable format.
  *
- * Parameters: Event c[] - array of structs of type Event
- *             int size - size of array
+ * Purpose: Takes the Events of a calendar that fall within the date
+ *          range, along with the repeats of repeating events that do, in
+ *          one pass over the array, sorts just those chronologically by
+ *          their start dates and times with sort_events(), and prints
+ *          them in a readable format, starting each day's group as the
+ *          day changes. Events outside the range are dropped from the
+ *          array without being sorted.
+ *
+ * Parameters: Calendar *cal - calendar holding the parsed Events
  *             int print_from - user specified start date
- *             int print_to - user specifed end date 
+ *             int print_to - user specifed end date
  */
 
-void sort_and_print(Event c[], int size, int print_from, int print_to){
-
-    char output[MAX_LINE_LEN], cur_date[MAX_LINE_LEN], formatted_time[MAX_LINE_LEN];
-    Event temp[1];
-    int min = 0;
-    int output_size = 0;
-    int increment = 0; 
-    char out[MAX_LINE_LEN], temporary[MAX_LINE_LEN];
-    
-    /* Expands repeating events and adds them to c[] */ 
-    for(int i = 0; i < size; i++){
-        if(c[i].repeat_until != NULL){
-            strncpy(temporary, c[i].repeat_until, MAX_LINE_LEN);
-            decrement_date(out, temporary, 7);
-            strncpy(cur_date, c[i].dtstart, MAX_LINE_LEN);
-            while(atoi(cur_date) <= atoi(out)){
-                increment_date(output, cur_date, 7);
-                strncpy(c[size].output, output, MAX_LINE_LEN);
-                c[size].start_time = c[i].start_time;
-                c[size].end_time = c[i].end_time;
-                c[size].location = c[i].location;
-                c[size].summary = c[i].summary;
-                strncpy(cur_date, output, MAX_LINE_LEN);
-                size++;               
+void sort_and_print(Calendar *cal, int print_from, int print_to){
+
+    static Output out;
+    Headers headers;
+
+    out.fd = STDOUT_FILENO;
+    headers.from = print_from;
+    headers.count = print_to >= print_from ? print_to - print_from + 1 : 0;
+    headers.days = count_calloc(headers.count ? headers.count : 1, sizeof(Header));
+    if(headers.days == NULL){
+        perror("calloc");
+        exit(1);
+    }
+    int parsed = cal->size, kept = 0;
+    int64_t start, lo, hi;
+    int first, last, repeat;
+    int day, prev = 0, start_secs, end_secs;
+    char *summary, *location;
+    Event *c;
+
+    /* Keeps the parsed events that start within the date range, moved
+     * down over those that do not, and appends the repeats of each
+     * repeating event that fall within it: the first one on or after
+     * print_from is found arithmetically, and the rule stops at print_to
+     * or UNTIL. The kept events stay ahead of the repeats, in file order,
+     * so that events with equal starts print in the same order as ever */
+    lo = (int64_t)print_from * SECS_PER_DAY;
+    hi = (int64_t)(print_to + 1) * SECS_PER_DAY;
+    for(int i = 0; i < parsed; i++){
+        if(cal->events[i].until != NO_RRULE){
+            first = day_of(cal->events[i].start);
+            last = cal->events[i].until < print_to ? cal->events[i].until : print_to;
+            repeat = print_from > first + 7 ? (print_from - first + 6) / 7 : 1;
+            start = cal->events[i].start + (int64_t)repeat * 7 * SECS_PER_DAY;
+            for(; day_of(start) <= last; start += 7 * SECS_PER_DAY){
+                Event *e = add_event(cal);
+                Event *r = &cal->events[i];
+                e->start = start;
+                e->end = start + (r->end - r->start);
+                e->until = NO_RRULE;
+                e->location = r->location;
+                e->summary = r->summary;
             }
         }
+        if(cal->events[i].start >= lo && cal->events[i].start < hi){
+            cal->events[kept++] = cal->events[i];
+        }
     }
+    memmove(cal->events + kept, cal->events + parsed,
+            (cal->size - parsed) * sizeof(Event));
+    kept += cal->size - parsed;
 
-    /* Orders events in chronological order by start date using selection sort*/
-    for(int k = 0; k < size - 1; k++){
-        min = k;
-        for(int j = k + 1; j < size; j++){
-            if(atoi(c[j].output) < atoi(c[min].output)){
-                min = j;
-            }else if(atoi(c[j].output) == atoi(c[min].output)){
-                if(atoi(c[j].start_time) < atoi(c[min].start_time)){
-                    min = j;
-                }
+    if(cal->stats != NULL){
+        cal->stats->generated = cal->size - parsed;
+        cal->stats->emitted = kept;
+        lap(cal->stats, EXPAND);
+    }
+    cal->size = kept;
+
+    /* Orders events in chronological order by start date and time */
+    sort_events(cal);
+    c = cal->events;
+    if(cal->stats != NULL) lap(cal->stats, SORT);
+
+    /* Prints a header before the first event of each day, with a blank
+     * line ahead of every header but the first */
+    for(int i = 0; i < kept; i++){
+        day = day_of(c[i].start);
+        start_secs = c[i].start - (int64_t)day * SECS_PER_DAY;
+        end_secs = c[i].end - (int64_t)day_of(c[i].end) * SECS_PER_DAY;
+        summary = cal->strings.str[c[i].summary];
+        location = cal->strings.str[c[i].location];
+        if(i == 0 || day != prev){
+            if(i != 0){
+                out_write(&out, "\n", 1);
             }
+            print_header(&out, &headers, day);
+            prev = day;
         }
-        temp[0] = c[k];
-        c[k] = c[min];
-        c[min] = temp[0];
-    }
-    
-    /* Determines number of events to be printed within date range*/
-    for(int i = 0; i < size; i++){
-        if(atoi(c[i].output) >= print_from && atoi(c[i].output) <= print_to){
-            output_size++;
-        }
-    } 
-    
-    /* Calls several print functions to output the events in c[] */
-    for(int i = 0; i < size; i++){
-        /* Check condition for valid date range */
-        if(atoi(c[i].output) >= print_from && atoi(c[i].output) <= print_to){
-        increment++;
-            /* If c[] only contains a single Event */
-            if(size == 1){
-                print_date(formatted_time, c[i].output, MAX_LINE_LEN);
-                print_line(formatted_time);
-                print_time_summary(atoi(c[i].start_time), atoi(c[i].end_time), c[i].summary, c[i].location);
-            }
-            /* Else c[] contains multiple events */
-            else{
-                /* If next event is on the same date, but the previous event was on a different date */
-                if((atoi(c[i+1].output) == atoi(c[i].output)) && (atoi(c[i-1].output) != atoi(c[i].output))){
-                    print_date(formatted_time, c[i].output, MAX_LINE_LEN);
-                    print_line(formatted_time);
-                    print_time_summary(atoi(c[i].start_time), atoi(c[i].end_time), c[i].summary, c[i].location);
-                }
-                /* If the previous event was on the same date */
-                else if(atoi(c[i-1].output) == atoi(c[i].output)){
-                    print_time_summary(atoi(c[i].start_time), atoi(c[i].end_time), c[i].summary, c[i].location);
-                    /* If not the last event to be printed, and next event is not on the same date, seperate output with line*/
-                    if(increment != (output_size) && atoi(c[i+1].output) != atoi(c[i].output)){
-                        printf("\n");
-                    }
-                }
-                /* Else the event is on a different date */
-                else{
-                    print_date(formatted_time, c[i].output, MAX_LINE_LEN);
-                    print_line(formatted_time);
-                    print_time_summary(atoi(c[i].start_time), atoi(c[i].end_time), c[i].summary, c[i].location);
-                    /* If not the last event to be printed, seperate output with a line */
-                    if(increment != (output_size)){
-                        printf("\n");
-                    }
-                }
-            }
+        print_time_summary(&out, start_secs, end_secs, summary, location);
+    }
+    out_flush(&out);
+    free_headers(&headers);
+    if(cal->stats != NULL) lap(cal->stats, PRINT);
+}
+
+
+/*
+ * Function: sort_events()
+ *
+ * Purpose: Orders the Events of a calendar by start key with a stable LSD
+ *          radix sort. Only compact keys (start - earliest start) and
+ *          indices are moved during the passes, RADIX_BITS bits at a time,
+ *          and just enough passes are made to cover the range of keys. The
+ *          Events themselves are then moved once, into their final order.
+ *
+ * Parameters: Calendar *cal - calendar to sort
+ */
+
+void sort_events(Calendar *cal){
+
+    int n = cal->size;
+    uint64_t *key, *key_tmp, *swap_key, range;
+    uint32_t *idx, *idx_tmp, *swap_idx;
+    size_t count[RADIX_SIZE];
+    int64_t min;
+    Event *sorted;
+
+    if(n < 2){
+        return;
+    }
+    key = count_malloc(2 * n * sizeof(uint64_t));
+    idx = count_malloc(2 * n * sizeof(uint32_t));
+    sorted = count_malloc(cal->capacity * sizeof(Event));
+    if(key == NULL || idx == NULL || sorted == NULL){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    key_tmp = key + n;
+    idx_tmp = idx + n;
+
+    min = cal->events[0].start;
+    for(int i = 1; i < n; i++){
+        if(cal->events[i].start < min){
+            min = cal->events[i].start;
+        }
+    }
+    range = 0;
+    for(int i = 0; i < n; i++){
+        key[i] = (uint64_t)(cal->events[i].start - min);
+        idx[i] = i;
+        range |= key[i];
+    }
+
+    for(int shift = 0; shift < 64 && (range >> shift) != 0; shift += RADIX_BITS){
+        size_t total = 0;
+        memset(count, 0, sizeof(count));
+        for(int i = 0; i < n; i++){
+            count[(key[i] >> shift) & (RADIX_SIZE - 1)]++;
+        }
+        for(int d = 0; d < RADIX_SIZE; d++){
+            size_t c = count[d];
+            count[d] = total;
+            total += c;
+        }
+        for(int i = 0; i < n; i++){
+            size_t at = count[(key[i] >> shift) & (RADIX_SIZE - 1)]++;
+            key_tmp[at] = key[i];
+            idx_tmp[at] = idx[i];
         }
+        swap_key = key; key = key_tmp; key_tmp = swap_key;
+        swap_idx = idx; idx = idx_tmp; idx_tmp = swap_idx;
     }
+
+    for(int i = 0; i < n; i++){
+        sorted[i] = cal->events[idx[i]];
+    }
+    free(cal->events);
+    cal->events = sorted;
+    free(key < key_tmp ? key : key_tmp);
+    free(idx < idx_tmp ? idx : idx_tmp);
 }
 
 
 /*
  * Function: print_date()
  *
- * Purpose: Given a date-time, creates a more readable version of the
- *          calendar date by using some C-library routines. For example,
- *          if the string in "dt_time" corresponds to: 20190520T111500
- *          then the string stored at "formatted_time" is: May 20, 2019 (Mon).
+ * Purpose: Given a day, creates a more readable version of the calendar
+ *          date using only integer arithmetic. For example, if "day" is
+ *          the day of 20190520T111500, then the string stored at
+ *          "formatted_time" is: May 20, 2019 (Mon).
  *
  * Parameters: char *formatted_time - address of a string to store the output
- *             cont char *dt_time - address of a string containing the the date
- *             const int len - length of the string at *dt_time 
- * 
- * Credit: Functioned copied from "timeplay.c" provided by Michael Zaztre
+ *             int day - days since 1970/01/01
+ *             const int len - size of the string at *formatted_time
+ *
+ * Returns: the length of the formatted date
  */
 
-void print_date(char *formatted_time, const char *dt_time, const int len){
+int print_date(char *formatted_time, int day, const int len){
 
-    struct tm temp_time;
-    time_t    full_time;
-    char      temp[5];
+    static const char *months[12] = {
+        "January", "February", "March", "April", "May", "June", "July",
+        "August", "September", "October", "November", "December"
+    };
+    static const char *days[7] = {
+        "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+    };
+    int y, m, d, n;
 
-    /*  
-     * Ignore for now everything other than the year, month and date.
-     * For conversion to work, months must be numbered from 0, and the 
-     * year from 1900.
-     */  
-    memset(&temp_time, 0, sizeof(struct tm));
-    sscanf(dt_time, "%4d%2d%2d", &temp_time.tm_year, &temp_time.tm_mon, &temp_time.tm_mday);
-    temp_time.tm_year -= 1900;
-    temp_time.tm_mon -= 1;
-    full_time = mktime(&temp_time);
-    strftime(formatted_time, len, "%B %d, %Y (%a)", localtime(&full_time));
-    printf("%s\n", formatted_time);
+    civil_from_days(day, &y, &m, &d);
+    n = snprintf(formatted_time, len, "%s %02d, %d (%s)", months[m - 1], d, y, days[weekday(day)]);
+    return n < len ? n : len - 1;
 }
 
 
 /*
- * Function: print_line()
- * 
- * Purpose: Prints a line with "-" mathching the size of a specified date
- * 
- * Parameters: char *output - string containing the date
+ * Function: print_header()
+ *
+ * Purpose: Appends the heading of a day, its date followed by a line of
+ *          "-" of the same length, to the output buffer. The heading of
+ *          each day in the date range is built the first time it is
+ *          needed and then kept, so later uses are a single copy.
+ *
+ * Parameters: Output *out - buffer the heading is appended to
+ *             Headers *headers - headings built so far, one per day in range
+ *             int day - days since 1970/01/01
  */
 
-void print_line(char *output){
-    for(int i = 0; i < strlen(output); i++){
-        printf("-");
+void print_header(Output *out, Headers *headers, int day){
+
+    char formatted_time[2 * MAX_LINE_LEN + 2];
+    Header *h = NULL;
+    int len;
+
+    if(day >= headers->from && day - headers->from < headers->count){
+        h = &headers->days[day - headers->from];
+        if(h->text != NULL){
+            out_write(out, h->text, h->len);
+            return;
+        }
+    }
+
+    len = print_date(formatted_time, day, MAX_LINE_LEN);
+    formatted_time[len] = '\n';
+    memset(formatted_time + len + 1, '-', len);
+    formatted_time[2 * len + 1] = '\n';
+    len = 2 * len + 2;
+    out_write(out, formatted_time, len);
+
+    if(h != NULL){
+        h->text = count_malloc(len);
+        if(h->text == NULL){
+            perror("malloc");
+            exit(1);
+        }
+        memcpy(h->text, formatted_time, len);
+        h->len = len;
     }
-    printf("\n");
+}
+
+
+/*
+ * Function: free_headers()
+ *
+ * Purpose: Frees the headings built by print_header()
+ *
+ * Parameters: Headers *headers - headings to free
+ */
+
+void free_headers(Headers *headers){
+    for(int i = 0; i < headers->count; i++){
+        free(headers->days[i].text);
+    }
+    free(headers->days);
 }
 
 
 /*
  * Function: print_time_summary()
  * 
- * Purpose: Converts the 24 hour time of an event into 12 hour time and prints
- *          it along with the summary and location of the event. 
+ * Purpose: Converts the 24 hour time of an event into 12 hour time and
+ *          appends it along with the summary and location of the event
+ *          to the output buffer
  * 
- * Parameters: int start - start time of event
- *             int end - end time of event
+ * Parameters: Output *out - buffer the line is appended to
+ *             int start - start time of event, in seconds after midnight
+ *             int end - end time of event, in seconds after midnight
  *             char *summary - summary of what the event is
  *             char *location - location of the event
  */
 
-void print_time_summary(int start, int end, char *summary, char *location){
-    
-    start /= 100;
-    end /= 100;
-
-    int start_min = start % 100;
-    int end_min = end % 100;
-    char *start_period;
-    char *end_period;
-
-    start /= 100;
-    end /= 100;
-    
-    if(start == 0){
-        start = 12;
-        start_period = "AM";
-    } else if(start == 12){
-        start_period = "PM";
-    } else if(start > 12){
-        start -= 12;
-        start_period = "PM";
-    } else{
-        start_period = "AM";
-    }
-
-    if(end == 0){
-        end = 12;
-        end_period = "AM";
-    } else if(end == 12){
-        end_period = "PM";
-    } else if(end > 12){
-        end -= 12;
-        end_period = "PM";
-    } else{
-        end_period = "AM";
-    }
-    
-    if(start < 10 && end < 10){
-        printf(" %d:%02d %s to  %d:%02d %s: %s {{%s}}\n", start, start_min, start_period, end, end_min, end_period, summary, location);
-    } else if(start < 10 && end >= 10){
-        printf(" %d:%02d %s to %d:%02d %s: %s {{%s}}\n", start, start_min, start_period, end, end_min, end_period, summary, location);
-    } else if(start >= 10 && end < 10){
-        printf("%d:%02d %s to  %d:%02d %s: %s {{%s}}\n", start, start_min, start_period, end, end_min, end_period, summary, location);
-    } else if(start >= 10 && end >= 10){
-        printf("%d:%02d %s to %d:%02d %s: %s {{%s}}\n", start, start_min, start_period, end, end_min, end_period, summary, location);
-    }
+void print_time_summary(Output *out, int start, int end, char *summary, char *location){
+
+    char times[] = "hh:mm AM to hh:mm AM: ";
+
+    format_time(times, start);
+    format_time(times + 12, end);
+    out_write(out, times, sizeof(times) - 1);
+    out_write(out, summary, strlen(summary));
+    out_write(out, " {{", 3);
+    out_write(out, location, strlen(location));
+    out_write(out, "}}\n", 3);
 }
 
 
 /*
- * Function: increment_date() 
- *
- * Purpose: Given a date-time, it adds the number of days in a way that
- *          results in the correct year, month, and day. For example,
- *          if the string in "before" corresponds to: 20190520T111500
- *          then the datetime string stored in "after", assuming that
- *          "num_days" is 100, will be: 20190828T111500 which is 100 days
- *          after May 20, 2019 (i.e., August 28, 2019).
+ * Function: format_time()
  *
- * Parameters: char *after - address of string to store incremented date
- *             const char *before - date to be incremented
- *             int const num_days - number of days to increment
+ * Purpose: Writes a time of day as "hh:mm AM" in 12 hour time, with the
+ *          hour padded by a space rather than a zero
  *
- * Credit: Function copied from "timeplay.c" provided by Michael Zastre.
+ * Parameters: char *buf - at least 8 characters to write into
+ *             int secs - seconds after midnight
  */
 
-void increment_date(char *after, const char *before, int const num_days){
+void format_time(char *buf, int secs){
 
-    struct tm temp_time, *p_temp_time;
-    time_t    full_time;
-    char      temp[5];
+    int hour = secs / 3600;
+    int min = secs / 60 % 60;
+    char period = hour >= 12 ? 'P' : 'A';
 
-    memset(&temp_time, 0, sizeof(struct tm));
-    sscanf(before, "%4d%2d%2d", &temp_time.tm_year,
-        &temp_time.tm_mon, &temp_time.tm_mday);
-    temp_time.tm_year -= 1900;
-    temp_time.tm_mon -= 1;
-    temp_time.tm_mday += num_days;
-
-    full_time = mktime(&temp_time);
-    after[0] = '\0';
-    strftime(after, 9, "%Y%m%d", localtime(&full_time));
-    strncpy(after + 8, before + 8, MAX_LINE_LEN - 8); 
-    after[MAX_LINE_LEN - 1] = '\0';
+    hour %= 12;
+    if(hour == 0){
+        hour = 12;
+    }
+    buf[0] = hour >= 10 ? '1' : ' ';
+    buf[1] = '0' + hour % 10;
+    buf[2] = ':';
+    buf[3] = '0' + min / 10;
+    buf[4] = '0' + min % 10;
+    buf[5] = ' ';
+    buf[6] = period;
+    buf[7] = 'M';
 }
 
 
 /*
- * Function: decrement_date()
- *
- * Purpose: Given a date-time, it subtracts the number of days in a way that
- *          results in the correct year, month, and day. For example,
- *          if the string in "before" corresponds to: 20190520T111500
- *          then the datetime string stored in "after", assuming that
- *          "num_days" is 100, will be: 20190409T111500 which is 100 days
- *          before May 20, 2019 (i.e., February 9, 2019).
+ * Function: out_write()
  *
- * Parameters: char *after - address of string to store decremented date
- *             const char *before - date to be decremeted
- *             int const num_days - number of days to decrement
+ * Purpose: Appends bytes to the output buffer. When they do not fit, the
+ *          buffered bytes and the new ones go out together in a single
+ *          writev() call instead of being copied first
  *
- * Credit: Function modified from "timeplay.c" provided by Michael Zastre.
+ * Parameters: Output *out - the output buffer
+ *             const char *data - bytes to append
+ *             size_t len - number of bytes at *data
  */
 
-void decrement_date(char *after, const char *before, int const num_days){
+void out_write(Output *out, const char *data, size_t len){
+
+    struct iovec iov[2];
+    ssize_t n;
+    int cnt = 0;
+
+    if(out->len + len <= OUTPUT_LEN){
+        memcpy(out->buf + out->len, data, len);
+        out->len += len;
+        return;
+    }
+    iov[cnt].iov_base = out->buf;
+    iov[cnt++].iov_len = out->len;
+    iov[cnt].iov_base = (char *)data;
+    iov[cnt++].iov_len = len;
+    while(cnt > 0){
+        n = writev(out->fd, iov + 2 - cnt, cnt);
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            perror("write");
+            exit(1);
+        }
+        while(cnt > 0 && (size_t)n >= iov[2 - cnt].iov_len){
+            n -= iov[2 - cnt].iov_len;
+            cnt--;
+        }
+        if(cnt > 0){
+            iov[2 - cnt].iov_base = (char *)iov[2 - cnt].iov_base + n;
+            iov[2 - cnt].iov_len -= n;
+        }
+    }
+    out->len = 0;
+}
+
+
+/*
+ * Function: out_flush()
+ *
+ * Purpose: Writes out whatever is left in the output buffer
+ *
+ * Parameters: Output *out - the output buffer
+ */
 
-    struct tm temp_time, *p_temp_time;
-    time_t    full_time;
-    char      temp[5];
+void out_flush(Output *out){
 
-    memset(&temp_time, 0, sizeof(struct tm));
-    sscanf(before, "%4d%2d%2d", &temp_time.tm_year,
-        &temp_time.tm_mon, &temp_time.tm_mday);
-    temp_time.tm_year -= 1900;
-    temp_time.tm_mon -= 1;
-    temp_time.tm_mday -= num_days;
+    size_t done = 0;
+    ssize_t n;
 
-    full_time = mktime(&temp_time);
-    after[0] = '\0';
-    strftime(after, 9, "%Y%m%d", localtime(&full_time));
-    strncpy(after + 8, before + 8, MAX_LINE_LEN - 8); 
-    after[MAX_LINE_LEN - 1] = '\0';
+    while(done < out->len){
+        n = write(out->fd, out->buf + done, out->len - done);
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            perror("write");
+            exit(1);
+        }
+        done += n;
+    }
+    out->len = 0;
 }
 
 
 /* 
- * Function: concatenate() 
+ * Function: days_from_civil() 
  * 
- * Purpose: Given a year, month, and day, concatenates them
- *          together to form a date. 
+ * Purpose: Given a year, month, and day, counts the days since
+ *          January 1, 1970, so that dates can be compared and stepped
+ *          as plain integers.
  * 
- * Parameters: int year, month, date - values to concatenate
+ * Parameters: int year, month, day - date to convert
  * 
- * Returns: int - concatenated date
+ * Returns: int32_t - days since 1970/01/01, negative for earlier dates
  * 
- * Credit: Inspired by funnction provided on "GeeksForGeeks: How to concatenate
- *         two integer values into one?" by Ayush Singla
+ * Credit: Howard Hinnant, "chrono-Compatible Low-Level Date Algorithms"
+ */
+
+int32_t days_from_civil(int year, int month, int day){
+
+    int y = year - (month <= 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + doe - 719468;
+}
+
+
+/*
+ * Function: civil_from_days()
+ *
+ * Purpose: The inverse of days_from_civil(); gives the year, month and
+ *          day of a count of days since 1970/01/01.
+ *
+ * Parameters: int32_t days - days since 1970/01/01
+ *             int *year, *month, *day - addresses to store the date
+ *
+ * Credit: Howard Hinnant, "chrono-Compatible Low-Level Date Algorithms"
  */
 
-int concatenate(int year, int month, int day){
+void civil_from_days(int32_t days, int *year, int *month, int *day){
+
+    int z = days + 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    int doe = z - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
 
-    char y[10];
-    char m[10];
-    char d[10];
-    sprintf(y, "%d", year);
-    sprintf(m, "%02d", month);
-    sprintf(d, "%02d", day);
-    strcat(m, d);
-    strcat(y, m);
-    return atoi(y);
+/*
+ * Function: weekday()
+ *
+ * Purpose: Gives the day of the week of a count of days since 1970/01/01
+ *          (which was a Thursday).
+ *
+ * Parameters: int32_t days - days since 1970/01/01
+ *
+ * Returns: int - 0 for Sunday through 6 for Saturday
+ *
+ * Credit: Howard Hinnant, "chrono-Compatible Low-Level Date Algorithms"
+ */
+
+int weekday(int32_t days){
+    return days >= -4 ? (days + 4) % 7 : (days + 5) % 7 + 6;
+}
+
+
+/*
+ * Function: parse_datetime()
+ *
+ * Purpose: Parses an ICS date-time such as "20210214T180000" (or a bare
+ *          date such as "20210214") into a single key counting seconds
+ *          since 1970/01/01 00:00:00. Keys are computed once when an event
+ *          is read, so that sorting and range tests compare one integer.
+ *
+ * Parameters: Span s - view of the date-time
+ *
+ * Returns: int64_t - the key
+ */
+
+int64_t parse_datetime(Span s){
+
+    int f[6] = {0, 0, 0, 0, 0, 0};
+    int width[6] = {4, 2, 2, 2, 2, 2};
+    size_t i = 0;
+
+    for(int k = 0; k < 6; k++){
+        if(k == 3){
+            if(i >= s.len || s.ptr[i] != 'T'){
+                break;
+            }
+            i++;
+        }
+        for(int n = 0; n < width[k] && i < s.len && s.ptr[i] >= '0' && s.ptr[i] <= '9'; n++){
+            f[k] = f[k] * 10 + (s.ptr[i++] - '0');
+        }
+    }
+    return (int64_t)days_from_civil(f[0], f[1], f[2]) * SECS_PER_DAY
+        + f[3] * 3600 + f[4] * 60 + f[5];
+}
+
+
+/*
+ * Function: day_of()
+ *
+ * Purpose: Gives the day that a key falls on.
+ *
+ * Parameters: int64_t key - seconds since 1970/01/01 00:00:00
+ *
+ * Returns: int32_t - days since 1970/01/01
+ */
+
+int32_t day_of(int64_t key){
+
+    int64_t day = key / SECS_PER_DAY;
+
+    return (int32_t)(key % SECS_PER_DAY < 0 ? day - 1 : day);
+}
+
+
+/*
+ * Function: open_input()
+ *
+ * Purpose: Prepares a file for reading. A regular file is mapped whole
+ *          and read-only into memory so that it can be scanned in place,
+ *          without first being copied into buffers. "-" selects stdin,
+ *          which is read one line at a time instead.
+ *
+ * Parameters: Input *in - input to fill in
+ *             const char *filename - name of file, or "-" for stdin
+ *
+ * Returns: int - 0 on success, -1 if the file could not be opened
+ */
+
+int open_input(Input *in, const char *filename){
+
+    struct stat sb;
+    int fd;
+
+    memset(in, 0, sizeof(Input));
+    if(strcmp(filename, "-") == 0){
+        in->stream = stdin;
+        return 0;
+    }
+    fd = open(filename, O_RDONLY);
+    if(fd < 0){
+        return -1;
+    }
+    if(fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode)){
+        close(fd);
+        return -1;
+    }
+    in->size = sb.st_size;
+    if(in->size != 0){
+        in->base = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(in->base == MAP_FAILED){
+            close(fd);
+            return -1;
+        }
+        madvise(in->base, in->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    return 0;
+}
+
+
+/*
+ * Function: close_input()
+ *
+ * Purpose: Releases the mapping or line buffer held by an Input.
+ *
+ * Parameters: Input *in - input to release
+ */
+
+void close_input(Input *in){
+    if(in->base != NULL){
+        munmap(in->base, in->size);
+    }
+    free(in->line);
+    memset(in, 0, sizeof(Input));
+}
+
+
+/*
+ * Function: next_property()
+ *
+ * Purpose: Finds the next line of the input and splits it at the first
+ *          ':' into a property name and value. Both are views into the
+ *          mapping (or, for a stream, into a line buffer that is reused
+ *          by the next call); nothing is copied. A trailing "\r" is dropped.
+ *
+ * Parameters: Input *in - input being scanned
+ *             Span *name - set to the text before the ':'
+ *             Span *value - set to the text after the ':'
+ *
+ * Returns: int - 1 if a line was found, 0 at the end of the input
+ */
+
+int next_property(Input *in, Span *name, Span *value){
+
+    const char *line, *eol, *colon;
+    ssize_t len;
+
+    if(in->stream != NULL){
+        if((len = getline(&in->line, &in->line_cap, in->stream)) == -1){
+            return 0;
+        }
+        in->pos += len;
+        line = in->line;
+        eol = line + len;
+        if(eol > line && eol[-1] == '\n'){
+            eol--;
+        }
+    }else{
+        const char *end = in->base + in->size;
+        if(in->pos >= in->size){
+            return 0;
+        }
+        line = in->base + in->pos;
+        eol = memchr(line, '\n', end - line);
+        if(eol == NULL){
+            eol = end;
+            in->pos = in->size;
+        }else{
+            in->pos = eol - in->base + 1;
+        }
+    }
+    if(eol > line && eol[-1] == '\r'){
+        eol--;
+    }
+    colon = memchr(line, ':', eol - line);
+    if(colon == NULL){
+        colon = eol;
+    }
+    in->lines++;
+    name->ptr = line;
+    name->len = colon - line;
+    value->ptr = colon < eol ? colon + 1 : eol;
+    value->len = eol - value->ptr;
+    return 1;
+}
+
+
+/*
+ * Function: hold_span()
+ *
+ * Purpose: Copies a view into a reusable buffer that grows geometrically,
+ *          so that it outlives the line it was taken from.
+ *
+ * Parameters: char **buf - address of the buffer
+ *             size_t *cap - address of the buffer's capacity
+ *             Span s - view to hold
+ *
+ * Returns: Span - a view of the held copy
+ */
+
+Span hold_span(char **buf, size_t *cap, Span s){
+
+    if(s.len > *cap){
+        size_t n = *cap ? *cap : MAX_LINE_LEN;
+        while(n < s.len){
+            n *= 2;
+        }
+        free(*buf);
+        if((*buf = count_malloc(n)) == NULL){
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        *cap = n;
+    }
+    if(s.len != 0){
+        memcpy(*buf, s.ptr, s.len);
+    }
+    return (Span){*buf, s.len};
+}
+
+
+/*
+ * Function: span_is()
+ *
+ * Purpose: Compares a view against a string.
+ *
+ * Parameters: Span s - view to compare
+ *             const char *str - string to compare against
+ *
+ * Returns: int - 1 if they hold the same characters, 0 otherwise
+ */
+
+int span_is(Span s, const char *str){
+    return strlen(str) == s.len && memcmp(s.ptr, str, s.len) == 0;
+}
+
+
+/*
+ * Function: intern()
+ *
+ * Purpose: Looks a string up in the table of distinct strings, adding a
+ *          copy of it if it is new. Events refer to their summary and
+ *          location by id, so the repeats of an event, and events at the
+ *          same location, share one copy. Lookup is by open addressing
+ *          over a table kept under three quarters full.
+ *
+ * Parameters: Strings *tab - table of distinct strings
+ *             Span s - string to look up
+ *
+ * Returns: uint32_t - id of the string, an index into tab->str
+ */
+
+uint32_t intern(Strings *tab, Span s){
+
+    uint32_t h = hash_span(s);
+    uint32_t at, id;
+
+    if((tab->count + 1) * 4 > tab->nslots * 3){
+        uint32_t nslots = tab->nslots ? tab->nslots * 2 : MIN_SLOTS;
+        uint32_t *slot = count_calloc(nslots, sizeof(uint32_t));
+        if(slot == NULL){
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        for(id = 0; id < tab->count; id++){
+            for(at = tab->hash[id] & (nslots - 1); slot[at] != 0; at = (at + 1) & (nslots - 1));
+            slot[at] = id + 1;
+        }
+        free(tab->slot);
+        tab->slot = slot;
+        tab->nslots = nslots;
+    }
+
+    for(at = h & (tab->nslots - 1); tab->slot[at] != 0; at = (at + 1) & (tab->nslots - 1)){
+        id = tab->slot[at] - 1;
+        if(tab->hash[id] == h && strncmp(tab->str[id], s.ptr, s.len) == 0 && tab->str[id][s.len] == '\0'){
+            return id;
+        }
+    }
+
+    if(tab->count == tab->cap){
+        tab->cap = tab->cap ? tab->cap * 2 : MIN_SLOTS;
+        tab->str = realloc(tab->str, tab->cap * sizeof(char *));
+        tab->hash = realloc(tab->hash, tab->cap * sizeof(uint32_t));
+        if(tab->str == NULL || tab->hash == NULL){
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    id = tab->count++;
+    tab->str[id] = copy_span(s);
+    tab->hash[id] = h;
+    tab->slot[at] = id + 1;
+    return id;
+}
+
+
+/*
+ * Function: hash_span()
+ *
+ * Purpose: Hashes a view with 32-bit FNV-1a.
+ *
+ * Parameters: Span s - view to hash
+ *
+ * Returns: uint32_t - the hash
+ */
+
+uint32_t hash_span(Span s){
+
+    uint32_t h = 2166136261u;
+
+    for(size_t i = 0; i < s.len; i++){
+        h = (h ^ (unsigned char)s.ptr[i]) * 16777619u;
+    }
+    return h;
+}
+
+
+/*
+ * Function: copy_span()
+ *
+ * Purpose: Copies a view into a newly allocated, terminated string.
+ *
+ * Parameters: Span s - view to copy
+ *
+ * Returns: char * - the copy
+ */
+
+char *copy_span(Span s){
+
+    char *str = count_malloc(s.len + 1);
+
+    if(str == NULL){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    if(s.len != 0){
+        memcpy(str, s.ptr, s.len);
+    }
+    str[s.len] = '\0';
+    return str;
+}
+
+
+/*
+ * Function: count_malloc(), count_calloc()
+ *
+ * Purpose: malloc() and calloc(), counting each block asked for in
+ *          heap_blocks, which --stats reports as "allocations".
+ */
+
+void *count_malloc(size_t n){
+    heap_blocks++;
+    return malloc(n);
+}
+
+
+void *count_calloc(size_t n, size_t size){
+    heap_blocks++;
+    return calloc(n, size);
+}
+
+
+/*
+ * Function: start_stopwatch()
+ *
+ * Purpose: Reads the wall clock and the CPU time of the process.
+ *
+ * Parameters: Stopwatch *w - set to the time now
+ */
+
+void start_stopwatch(Stopwatch *w){
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    w->wall = ts.tv_sec + ts.tv_nsec / 1e9;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    w->cpu = ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*
+ * Function: lap()
+ *
+ * Purpose: Charges the time since the last lap to a step of the run, and
+ *          starts timing the next.
+ *
+ * Parameters: Stats *stats - statistics being kept
+ *             int phase - the step that has just finished
+ */
+
+void lap(Stats *stats, int phase){
+
+    Stopwatch now;
+
+    start_stopwatch(&now);
+    stats->wall[phase] += now.wall - stats->lap.wall;
+    stats->cpu[phase] += now.cpu - stats->lap.cpu;
+    stats->lap = now;
+}
+
+
+/*
+ * Function: print_stats()
+ *
+ * Purpose: Writes the time of each step and the counts as a table, or as
+ *          one line of JSON, with the peak resident size of the process.
+ *          "allocations" counts the blocks asked of malloc() and
+ *          calloc() over the run; growing one with realloc() is not
+ *          counted. Events are filtered as they are expanded, so that
+ *          time is part of "expand".
+ *
+ * Parameters: FILE *f - where to write them
+ *             const Stats *stats - statistics of the run
+ *             int json - whether to write JSON
+ */
+
+void print_stats(FILE *f, const Stats *stats, int json){
+
+    static const char *names[NUM_PHASES] = {
+        "parse", "expand", "sort", "print"
+    };
+    const char *counts[6] = {
+        "lines", "bytes", "vevents", "generated", "emitted", "allocations"
+    };
+    uint64_t values[6] = {
+        stats->lines, stats->bytes, stats->vevents, stats->generated,
+        stats->emitted, stats->allocations
+    };
+    struct rusage ru;
+    long rss = getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss : 0;
+
+    if(json){
+        fprintf(f, "{\"phases\":[");
+        for(int i = 0; i < NUM_PHASES; i++){
+            fprintf(f, "%s{\"name\":\"%s\",\"wall\":%.6f,\"cpu\":%.6f}",
+                    i ? "," : "", names[i], stats->wall[i], stats->cpu[i]);
+        }
+        fprintf(f, "]");
+        for(int i = 0; i < 6; i++){
+            fprintf(f, ",\"%s\":%llu", counts[i], (unsigned long long)values[i]);
+        }
+        fprintf(f, ",\"peak_rss_kb\":%ld}\n", rss);
+        return;
+    }
+
+    fprintf(f, "%-12s %12s %12s\n", "phase", "wall s", "cpu s");
+    for(int i = 0; i < NUM_PHASES; i++){
+        fprintf(f, "%-12s %12.6f %12.6f\n", names[i], stats->wall[i], stats->cpu[i]);
+    }
+    for(int i = 0; i < 6; i++){
+        fprintf(f, "%-12s %12llu\n", counts[i], (unsigned long long)values[i]);
+    }
+    fprintf(f, "%-12s %12ld\n", "peak rss kB", rss);
+}
+
+
+#ifdef SORT_BENCH
+
+/*
+ * Benchmark of sort_events() against the selection sort it replaced.
+ * Build and run with:
+ *
+ *     gcc -O2 -DSORT_BENCH -o sortbench icsout.c && ./sortbench
+ *
+ * Prints one CSV line per size: occurrences, and seconds taken by each
+ * sort ("-" where the quadratic sort would take too long to be useful).
+ */
+
+#define BENCH_SELECTION_MAX 100000
+
+void selection_sort(Event c[], int size){
+
+    Event temp;
+    int min;
+
+    for(int k = 0; k < size - 1; k++){
+        min = k;
+        for(int j = k + 1; j < size; j++){
+            if(c[j].start < c[min].start){
+                min = j;
+            }
+        }
+        temp = c[k];
+        c[k] = c[min];
+        c[min] = temp;
+    }
+}
+
+
+double seconds(void){
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+void fill(Calendar *cal, int n){
+
+    int64_t base = (int64_t)days_from_civil(2020, 1, 1) * SECS_PER_DAY;
+
+    cal->size = 0;
+    srand(n);
+    for(int i = 0; i < n; i++){
+        Event *e = add_event(cal);
+        e->start = base + (int64_t)(rand() % (3650 * 96)) * 900;
+        e->end = e->start + 3600;
+        e->until = NO_RRULE;
+    }
+}
+
+
+int main(void){
+
+    static const int sizes[] = {1000, 3000, 10000, 30000, 100000,
+                                1000000, 10000000};
+    Calendar cal = {0};
+    double t, radix, selection;
+
+    printf("occurrences,radix_s,selection_s\n");
+    for(int k = 0; k < (int)(sizeof(sizes) / sizeof(sizes[0])); k++){
+        int n = sizes[k];
+
+        fill(&cal, n);
+        t = seconds();
+        sort_events(&cal);
+        radix = seconds() - t;
+        for(int i = 1; i < n; i++){
+            if(cal.events[i - 1].start > cal.events[i].start){
+                fprintf(stderr, "sort_events: out of order at %d\n", i);
+                exit(1);
+            }
+        }
+
+        if(n <= BENCH_SELECTION_MAX){
+            fill(&cal, n);
+            t = seconds();
+            selection_sort(cal.events, n);
+            selection = seconds() - t;
+            printf("%d,%.6f,%.6f\n", n, radix, selection);
+        }else{
+            printf("%d,%.6f,-\n", n, radix);
+        }
+        fflush(stdout);
+    }
+    free(cal.events);
+    return 0;
 }
 
+#endif
@@ -0,0 +1,64 @@
+/*
+ * arena.c
+ *
+ * Bump allocator. Objects are carved in order out of large slabs, so
+ * that objects allocated together sit together in memory, and the whole
+ * arena is released at once by arena_free(). Individual objects are
+ * never freed. Each new slab is twice the size of the last, up to
+ * SLAB_MAX.
+ */
+
+#include <stdalign.h>
+#include <stdlib.h>
+#include "emalloc.h"
+#include "arena.h"
+
+#define SLAB_MIN    (64 * 1024)
+#define SLAB_MAX    (4 * 1024 * 1024)
+#define ALIGN(n)    (((n) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1))
+
+
+static slab_t *new_slab(size_t size) {
+    slab_t *slab = emalloc(sizeof(slab_t) + size);
+
+    slab->next = NULL;
+    slab->used = 0;
+    slab->size = size;
+    return slab;
+}
+
+
+void *arena_alloc(arena_t *arena, size_t n) {
+    slab_t *slab = arena->slabs;
+    size_t size;
+    void *p;
+
+    n = ALIGN(n);
+    if (slab == NULL || slab->size - slab->used < n) {
+        size = slab == NULL ? SLAB_MIN : slab->size * 2;
+        if (size > SLAB_MAX) {
+            size = SLAB_MAX;
+        }
+        if (size < n) {
+            size = n;
+        }
+        slab = new_slab(size);
+        slab->next = arena->slabs;
+        arena->slabs = slab;
+    }
+
+    p = (char *)slab->data + slab->used;
+    slab->used += n;
+    return p;
+}
+
+
+void arena_free(arena_t *arena) {
+    slab_t *slab, *next;
+
+    for (slab = arena->slabs; slab != NULL; slab = next) {
+        next = slab->next;
+        free(slab);
+    }
+    arena->slabs = NULL;
+}
@@ -0,0 +1,19 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+typedef struct slab_t {
+    struct slab_t  *next;
+    size_t          used;
+    size_t          size;
+    max_align_t     data[];
+} slab_t;
+
+typedef struct arena_t {
+    slab_t         *slabs;
+} arena_t;
+
+void   *arena_alloc(arena_t *, size_t);
+void    arena_free(arena_t *);
+#endif
@@ -0,0 +1,278 @@
+/*
+ * cache.c
+ *
+ * Sidecar index. After a calendar has been parsed its events, before
+ * expansion, and its string table are saved next to it as cal.ics.idx,
+ * and later runs map that file instead of parsing the calendar again.
+ *
+ * Layout, in host byte order:
+ *
+ *      header_t                    which source the index was built from
+ *      event_t     [nevents]       in the order of the calendar
+ *      uint32_t    [nstrings]      offset of each string, by id
+ *      char        [string_bytes]  the strings, each ending in '\0'
+ *
+ * The index is used when the calendar's size and modification time
+ * match the header. If only the time differs, as after a copy, the
+ * calendar is hashed and the index is used if the hash matches too.
+ * Every string id, offset and rule in it is checked before it is used,
+ * so a damaged index is ignored rather than read out of bounds.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "emalloc.h"
+#include "cache.h"
+#include "rrule.h"
+
+#define CACHE_MAGIC     "ICSIDX\0"
+#define CACHE_VERSION   3       /* bump when event_t or the layout changes */
+
+typedef struct header_t {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    event_size;     /* sizeof(event_t) of the writer */
+    uint64_t    src_size;
+    int64_t     src_mtime;      /* seconds */
+    int64_t     src_mtime_ns;
+    uint64_t    src_hash;
+    uint32_t    nevents;
+    uint32_t    nstrings;
+    uint64_t    string_bytes;
+} header_t;
+
+
+/*
+ * FNV-1a, 64 bit, over the whole calendar.
+ */
+static uint64_t hash_file(const char *filename, size_t size) {
+    uint64_t h = 14695981039346656037ULL;
+    const unsigned char *p;
+    void *base;
+    size_t i;
+    int fd;
+
+    if (size == 0) {
+        return h;
+    }
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return 0;
+    }
+    madvise(base, size, MADV_SEQUENTIAL);
+    for (p = base, i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    munmap(base, size);
+    return h;
+}
+
+
+static char *cache_name(const char *icsfile) {
+    char *name = emalloc(strlen(icsfile) + sizeof(CACHE_SUFFIX));
+
+    strcpy(name, icsfile);
+    strcat(name, CACHE_SUFFIX);
+    return name;
+}
+
+
+/*
+ * Checks that a saved event only names strings in the index and, if it
+ * repeats, has a rule that rrule_next() can step through.
+ */
+static int event_valid(const event_t *e, uint32_t nstrings) {
+    const rrule_t *r = &e->rule;
+
+    if (e->summary >= nstrings || e->location >= nstrings) {
+        return 0;
+    }
+    return e->until == NO_RRULE ||
+           (r->freq <= RRULE_MONTHLY && r->interval >= 1 && r->wkst < 7 &&
+            r->byday < 0x80);
+}
+
+
+/*
+ * Checks that the mapped index is whole and was built from the calendar
+ * as it is now: the sections add up to the file, every offset is inside
+ * the strings and the last string is terminated, so that each offset
+ * starts one, and every event is valid.
+ */
+static int cache_valid(const cache_t *c, const char *icsfile,
+                       const struct stat *src) {
+    const header_t *h = c->base;
+    const event_t *events;
+    const uint32_t *offsets;
+    const char *strings;
+    uint64_t need;
+    uint32_t i;
+
+    if (c->size < sizeof(header_t) ||
+        memcmp(h->magic, CACHE_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != CACHE_VERSION || h->event_size != sizeof(event_t) ||
+        h->string_bytes > c->size) {
+        return 0;
+    }
+    need = sizeof(header_t) + (uint64_t)h->nevents * sizeof(event_t) +
+           (uint64_t)h->nstrings * sizeof(uint32_t) + h->string_bytes;
+    if (need != c->size || h->src_size != (uint64_t)src->st_size) {
+        return 0;
+    }
+
+    events = (const event_t *)((const char *)c->base + sizeof(header_t));
+    offsets = (const uint32_t *)(events + h->nevents);
+    strings = (const char *)(offsets + h->nstrings);
+    if (h->string_bytes > 0 && strings[h->string_bytes - 1] != '\0') {
+        return 0;
+    }
+    for (i = 0; i < h->nstrings; i++) {
+        if (offsets[i] >= h->string_bytes) {
+            return 0;
+        }
+    }
+    for (i = 0; i < h->nevents; i++) {
+        if (!event_valid(&events[i], h->nstrings)) {
+            return 0;
+        }
+    }
+
+    if (h->src_mtime == src->st_mtim.tv_sec &&
+        h->src_mtime_ns == src->st_mtim.tv_nsec) {
+        return 1;
+    }
+    return h->src_hash == hash_file(icsfile, src->st_size);
+}
+
+
+int cache_open(cache_t *c, const char *icsfile) {
+    struct stat src, sb;
+    char *name = cache_name(icsfile);
+    const header_t *h;
+    void *base;
+    int fd;
+
+    memset(c, 0, sizeof(cache_t));
+    fd = open(name, O_RDONLY);
+    free(name);
+    if (fd < 0) {
+        return -1;
+    }
+    if (stat(icsfile, &src) != 0 || fstat(fd, &sb) != 0 ||
+        sb.st_size < (off_t)sizeof(header_t)) {
+        close(fd);
+        return -1;
+    }
+    base = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+    c->base = base;
+    c->size = sb.st_size;
+    if (!cache_valid(c, icsfile, &src)) {
+        cache_close(c);
+        return -1;
+    }
+
+    h = base;
+    c->events = (event_t *)((char *)base + sizeof(header_t));
+    c->nevents = h->nevents;
+    c->offsets = (const uint32_t *)(c->events + h->nevents);
+    c->strings = (const char *)(c->offsets + h->nstrings);
+    c->nstrings = h->nstrings;
+    return 0;
+}
+
+
+const char *cache_string(const cache_t *c, uint32_t id) {
+    return c->strings + c->offsets[id];
+}
+
+
+void cache_close(cache_t *c) {
+    if (c->base != NULL) {
+        munmap(c->base, c->size);
+    }
+    memset(c, 0, sizeof(cache_t));
+}
+
+
+/*
+ * Writes the index to a temporary file and renames it into place, so
+ * that a reader never sees half of one. The index is only a cache:
+ * on any failure it is simply not written.
+ */
+int cache_write(const char *icsfile, const event_t *events, uint32_t n,
+                const strtab_t *strings) {
+    struct stat src;
+    header_t h;
+    char *name = cache_name(icsfile);
+    char *tmp = emalloc(strlen(name) + 32);
+    uint32_t *offsets = emalloc((strings->count + 1) * sizeof(uint32_t));
+    uint64_t bytes = 0;
+    uint32_t i;
+    FILE *f = NULL;
+    int ok = 0;
+
+    if (stat(icsfile, &src) != 0) {
+        goto done;
+    }
+    for (i = 0; i < strings->count; i++) {
+        offsets[i] = bytes;
+        bytes += strlen(strtab_get(strings, i)) + 1;
+    }
+    if (bytes > UINT32_MAX) {
+        goto done;
+    }
+
+    memset(&h, 0, sizeof(header_t));
+    memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+    h.version = CACHE_VERSION;
+    h.event_size = sizeof(event_t);
+    h.src_size = src.st_size;
+    h.src_mtime = src.st_mtim.tv_sec;
+    h.src_mtime_ns = src.st_mtim.tv_nsec;
+    h.src_hash = hash_file(icsfile, src.st_size);
+    h.nevents = n;
+    h.nstrings = strings->count;
+    h.string_bytes = bytes;
+
+    sprintf(tmp, "%s.%ld", name, (long)getpid());
+    f = fopen(tmp, "wb");
+    if (f == NULL) {
+        goto done;
+    }
+    ok = fwrite(&h, sizeof(header_t), 1, f) == 1 &&
+         fwrite(events, sizeof(event_t), n, f) == n &&
+         fwrite(offsets, sizeof(uint32_t), strings->count, f) == strings->count;
+    for (i = 0; ok && i < strings->count; i++) {
+        const char *s = strtab_get(strings, i);
+        ok = fwrite(s, 1, strlen(s) + 1, f) == strlen(s) + 1;
+    }
+    if (fclose(f) != 0) {
+        ok = 0;
+    }
+    if (ok && rename(tmp, name) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        unlink(tmp);
+    }
+
+done:
+    free(offsets);
+    free(tmp);
+    free(name);
+    return ok ? 0 : -1;
+}
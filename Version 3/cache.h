@@ -0,0 +1,30 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ics.h"
+#include "strtab.h"
+
+#define CACHE_SUFFIX ".idx"
+
+/*
+ * A calendar's events as saved in its sidecar file, mapped copy-on-write
+ * so that the events can be renumbered in place.
+ */
+typedef struct cache_t {
+    void           *base;
+    size_t          size;
+    event_t        *events;
+    uint32_t        nevents;
+    const uint32_t *offsets;    /* id -> offset of string in strings */
+    const char     *strings;
+    uint32_t        nstrings;
+} cache_t;
+
+int          cache_open(cache_t *, const char *icsfile);
+const char  *cache_string(const cache_t *, uint32_t id);
+void         cache_close(cache_t *);
+int          cache_write(const char *icsfile, const event_t *, uint32_t,
+                         const strtab_t *);
+#endif
@@ -0,0 +1,62 @@
+/*
+ * dates.c
+ *
+ * Events are keyed by the number of seconds since 1970-01-01T00:00:00 of
+ * their floating (timezone-less) start and end times, so that ordering,
+ * range tests and grouping by day are plain integer operations. Keys are
+ * computed once, when an event is read, and turned back into text with
+ * the arithmetic in dates.h rather than mktime()/localtime().
+ */
+
+#include <stdio.h>
+#include "dates.h"
+
+static const char *month_names[12] = {
+    "January", "February", "March", "April", "May", "June", "July",
+    "August", "September", "October", "November", "December"
+};
+
+static const char *day_names[7] = {
+    "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+};
+
+
+/*
+ * Parses "yyyymmdd" or "yyyymmddThhmmss" into a key. Missing or short
+ * fields are taken as zero.
+ */
+int64_t parse_datetime(const char *s, size_t len) {
+    int f[6] = {0, 0, 0, 0, 0, 0};
+    int width[6] = {4, 2, 2, 2, 2, 2};
+    size_t i = 0;
+    int k, n;
+
+    for (k = 0; k < 6; k++) {
+        if (k == 3) {
+            if (i >= len || s[i] != 'T') {
+                break;
+            }
+            i++;
+        }
+        for (n = 0; n < width[k] && i < len && s[i] >= '0' && s[i] <= '9'; n++) {
+            f[k] = f[k] * 10 + (s[i++] - '0');
+        }
+    }
+
+    return (int64_t)days_from_civil(f[0], f[1], f[2]) * SECS_PER_DAY
+        + f[3] * 3600 + f[4] * 60 + f[5];
+}
+
+
+/*
+ * Writes a day as, for example, "February 14, 2021 (Sun)", the same
+ * text strftime()'s "%B %d, %Y (%a)" gives. Returns the length written
+ * (as snprintf() does).
+ */
+int format_day(char *buf, size_t len, int32_t days) {
+    int year, month, day;
+
+    civil_from_days(days, &year, &month, &day);
+    return snprintf(buf, len, "%s %02d, %d (%s)", month_names[month - 1],
+                    day, year, day_names[weekday(days)]);
+}
@@ -0,0 +1,60 @@
+#ifndef _DATES_H_
+#define _DATES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SECS_PER_DAY 86400
+
+/*
+ * Pure-arithmetic civil calendar (proleptic Gregorian, no timezone).
+ * Days are counted from 1970-01-01; keys are seconds from its midnight.
+ * The conversions are defined here so that calls with constant
+ * arguments fold away at compile time.
+ *
+ * Algorithms from Howard Hinnant, "chrono-Compatible Low-Level Date
+ * Algorithms".
+ */
+
+static inline int32_t days_from_civil(int year, int month, int day) {
+    int y = year - (month <= 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + doe - 719468;
+}
+
+static inline void civil_from_days(int32_t days, int *year, int *month,
+                                   int *day) {
+    int z = days + 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    int doe = z - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+/* 0 = Sunday ... 6 = Saturday */
+static inline int weekday(int32_t days) {
+    return days >= -4 ? (days + 4) % 7 : (days + 5) % 7 + 6;
+}
+
+static inline int32_t key_day(int64_t key) {
+    int64_t day = key / SECS_PER_DAY;
+
+    return (int32_t)(key % SECS_PER_DAY < 0 ? day - 1 : day);
+}
+
+static inline int32_t key_secs(int64_t key) {
+    return (int32_t)(key - (int64_t)key_day(key) * SECS_PER_DAY);
+}
+
+int64_t parse_datetime(const char *, size_t);
+int     format_day(char *, size_t, int32_t);
+#endif
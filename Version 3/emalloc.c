@@ -0,0 +1,34 @@
+/*
+ * emalloc.c
+ *
+ * malloc() that never returns NULL: running out of memory is reported
+ * and ends the program, so callers need not check. Every block is
+ * counted, arena slabs among them, for --stats to report; the count is
+ * kept atomically, as the parse threads allocate at the same time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "emalloc.h"
+
+static uint64_t count;
+
+
+void *emalloc(size_t n) {
+    void *p = malloc(n);
+
+    __atomic_fetch_add(&count, 1, __ATOMIC_RELAXED);
+    if (p == NULL) {
+        fprintf(stderr, "malloc of %zu bytes failed\n", n);
+        exit(1);
+    }
+    return p;
+}
+
+
+/*
+ * Returns the number of blocks emalloc() has handed out.
+ */
+uint64_t emalloc_count(void) {
+    return __atomic_load_n(&count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,9 @@
+#ifndef _EMALLOC_H_
+#define _EMALLOC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+void    *emalloc(size_t);
+uint64_t emalloc_count(void);
+#endif
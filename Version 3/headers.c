@@ -0,0 +1,74 @@
+/*
+ * headers.c
+ *
+ * Cache of day headings: the formatted date, its underline of dashes
+ * and both newlines, ready to be copied to the output as one piece.
+ * The table covers the query window and a heading is only built the
+ * first time its day is asked for, so a window of many years costs one
+ * pointer pair per day until something is printed on it. Days outside
+ * the window are formatted into a spare buffer each time.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "emalloc.h"
+#include "dates.h"
+#include "headers.h"
+
+
+/*
+ * Formats the heading for a day into buf, which holds HEADER_LEN
+ * characters, and returns its length.
+ */
+static size_t format_header(char *buf, int32_t day) {
+    int len = format_day(buf, MAX_LEN, day);
+
+    if (len >= MAX_LEN) {
+        len = MAX_LEN - 1;
+    }
+    buf[len] = '\n';
+    memset(buf + len + 1, '-', len);
+    buf[2 * len + 1] = '\n';
+    return 2 * len + 2;
+}
+
+
+void headers_init(headers_t *h, int32_t from, int32_t to) {
+    memset(&h->arena, 0, sizeof(arena_t));
+    h->from = from;
+    h->count = to >= from ? to - from + 1 : 0;
+    h->days = NULL;
+    if (h->count > 0) {
+        h->days = emalloc(h->count * sizeof(header_t));
+        memset(h->days, 0, h->count * sizeof(header_t));
+    }
+}
+
+
+const header_t *headers_get(headers_t *h, int32_t day) {
+    header_t *entry;
+    char *text;
+
+    if (day < h->from || day - h->from >= h->count) {
+        h->outside.text = h->spare;
+        h->outside.len = format_header(h->spare, day);
+        return &h->outside;
+    }
+
+    entry = &h->days[day - h->from];
+    if (entry->text == NULL) {
+        entry->len = format_header(h->spare, day);
+        text = arena_alloc(&h->arena, entry->len);
+        memcpy(text, h->spare, entry->len);
+        entry->text = text;
+    }
+    return entry;
+}
+
+
+void headers_free(headers_t *h) {
+    free(h->days);
+    arena_free(&h->arena);
+    h->days = NULL;
+    h->count = 0;
+}
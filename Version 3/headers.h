@@ -0,0 +1,29 @@
+#ifndef _HEADERS_H_
+#define _HEADERS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+#include "ics.h"
+
+/* "May 20, 2019 (Mon)\n------------------\n" */
+#define HEADER_LEN   (2 * MAX_LEN + 2)
+
+typedef struct header_t {
+    const char  *text;      /* NULL until the day is first asked for */
+    size_t       len;
+} header_t;
+
+typedef struct headers_t {
+    arena_t      arena;     /* bytes of the headers */
+    int32_t      from;      /* day of days[0] */
+    int32_t      count;
+    header_t    *days;
+    header_t     outside;   /* a day outside the window, built in spare */
+    char         spare[HEADER_LEN];
+} headers_t;
+
+void             headers_init(headers_t *, int32_t from, int32_t to);
+const header_t  *headers_get(headers_t *, int32_t day);
+void             headers_free(headers_t *);
+#endif
@@ -1,18 +1,30 @@
 #ifndef _ICS_H_
 #define _ICS_H_
 
-#define DT_LEN       16
-#define TM_LEN       8
+#include <stdint.h>
+
 #define MAX_LEN      80
+#define NO_RRULE     INT64_MIN
+#define RRULE_NTH    7
+
+/* An RRULE compiled by rrule_compile(); see rrule.c */
+typedef struct rrule_t{
+    uint32_t monthdays;         /* BYMONTHDAY, bit d - 1 = day d, bit 31 = -1 */
+    uint16_t interval;          /* periods between repeats, at least 1 */
+    uint8_t freq;               /* RRULE_DAILY, RRULE_WEEKLY or RRULE_MONTHLY */
+    uint8_t wkst;               /* first day of the week, 0 = Sunday */
+    uint8_t byday;              /* weekdays, bit 0 = Sunday, or 0 */
+    int8_t nth[RRULE_NTH];      /* "2TU" as 2 * 8 + weekday, or 0 */
+} rrule_t;
 
 typedef struct event_t{
-    char dtstart[DT_LEN];
-    char tmstart[TM_LEN];
-    char dtend[DT_LEN];
-    char tmend[TM_LEN];
-    char summary[MAX_LEN];
-    char location[MAX_LEN];
-    char rrule[DT_LEN];
+    int64_t start;              /* seconds since 1970-01-01T00:00:00 */
+    int64_t end;
+    int64_t until;              /* latest start of a repeat, or NO_RRULE */
+    uint32_t summary;           /* ids in the calendar's strtab_t */
+    uint32_t location;
+    uint32_t block;             /* VEVENT it came from, when watched */
+    rrule_t rule;               /* how it repeats, unless until is NO_RRULE */
 } event_t;
 
 #endif
@@ -0,0 +1,307 @@
+/*
+ * icsbench.c
+ *
+ * Benchmark over synthetic calendars of growing size. For each size,
+ * from --min to --max occurrences by factors of ten, a calendar is
+ * written with synth_write() and then
+ *
+ *     - each program given by --icsout= and --icsout3= is run on it
+ *       --runs times, asked for a window of --window days in the middle
+ *       of the events, with its output thrown away, and the steps its
+ *       --stats=json gives for the fastest run are reported as well;
+ *     - the same window is read in-process with libics, timing
+ *       ics_open(), ics_query_range() and report() on their own.
+ *
+ *     icsbench [--icsout=path] [--icsout3=path] [--min=n] [--max=n]
+ *              [--runs=n] [--window=days] [--repeat=percent]
+ *              [--span=days] [--summary=len] [--location=len]
+ *              [--days=n] [--seed=n] [--dir=path] [--keep]
+ *
+ * Results are CSV on stdout, one line per program, size and phase:
+ *
+ *     program,occurrences,events,bytes,window,phase,seconds,max_rss_kb
+ *
+ * "seconds" is the best of the runs, "total" being the whole process.
+ * max_rss_kb is only given for whole processes. Sizes are met as
+ * nearly as the shape of the calendar allows; "occurrences" is the
+ * number actually written.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "dates.h"
+#include "headers.h"
+#include "libics.h"
+#include "outbuf.h"
+#include "report.h"
+#include "synth.h"
+
+#define BENCH_PATH_LEN  4096
+#define BENCH_STATS_LEN 4096    /* bytes of --stats=json kept */
+
+typedef struct bench_t {
+    const char *icsout;         /* programs to run, or NULL */
+    const char *icsout3;
+    int         runs;
+    int         from;           /* window asked for */
+    int         to;
+    long        occurrences;    /* of the current calendar */
+    long        events;
+    long long   bytes;
+} bench_t;
+
+double  seconds(void);
+void    run_program(const bench_t *, const char *name, const char *prog,
+                    const char *path);
+void    run_libics(const bench_t *, const char *path);
+
+int main(int argc, char *argv[]){
+
+    bench_t b = {NULL, NULL, 3, 0, 0, 0, 0, 0};
+    synth_t s;
+    const char *dir = "/tmp";
+    char path[BENCH_PATH_LEN];
+    long min = 100, max = 10000000, n;
+    int window = 30, keep = 0, bad = 0;
+    struct stat sb;
+    FILE *f;
+    int i;
+
+    synth_defaults(&s);
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--icsout=", 9) == 0) {
+            b.icsout = argv[i]+9;
+        } else if (strncmp(argv[i], "--icsout3=", 10) == 0) {
+            b.icsout3 = argv[i]+10;
+        } else if (strncmp(argv[i], "--min=", 6) == 0) {
+            min = atol(argv[i]+6);
+        } else if (strncmp(argv[i], "--max=", 6) == 0) {
+            max = atol(argv[i]+6);
+        } else if (strncmp(argv[i], "--runs=", 7) == 0) {
+            b.runs = atoi(argv[i]+7);
+        } else if (strncmp(argv[i], "--window=", 9) == 0) {
+            window = atoi(argv[i]+9);
+        } else if (strncmp(argv[i], "--repeat=", 9) == 0) {
+            s.repeat = atoi(argv[i]+9);
+        } else if (strncmp(argv[i], "--span=", 7) == 0) {
+            s.span = atoi(argv[i]+7);
+        } else if (strncmp(argv[i], "--summary=", 10) == 0) {
+            s.summary = atoi(argv[i]+10);
+        } else if (strncmp(argv[i], "--location=", 11) == 0) {
+            s.location = atoi(argv[i]+11);
+        } else if (strncmp(argv[i], "--days=", 7) == 0) {
+            s.days = atoi(argv[i]+7);
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            s.seed = strtoull(argv[i]+7, NULL, 10);
+        } else if (strncmp(argv[i], "--dir=", 6) == 0) {
+            dir = argv[i]+6;
+        } else if (strcmp(argv[i], "--keep") == 0) {
+            keep = 1;
+        } else {
+            bad = 1;
+        }
+    }
+
+    if (bad || min < 1 || max < min || b.runs < 1 || window < 1
+        || s.repeat < 0 || s.repeat > 100 || s.span < 0 || s.summary < 0
+        || s.location < 0 || s.days < 1) {
+        fprintf(stderr,
+            "usage: %s [--icsout=path] [--icsout3=path] [--min=n] [--max=n] [--runs=n]\n"
+            "       [--window=days] [--repeat=percent] [--span=days] [--summary=len]\n"
+            "       [--location=len] [--days=n] [--seed=n] [--dir=path] [--keep]\n",
+            argv[0]);
+        exit(1);
+    }
+
+    /* The window sits in the middle of the starts, so that it also
+     * catches repeats of events that began before it */
+    b.from = s.first + (s.days > window ? (s.days - window) / 2 : 0);
+    b.to = b.from + window - 1;
+
+    printf("program,occurrences,events,bytes,window,phase,seconds,max_rss_kb\n");
+    for (n = min; n <= max; n *= 10) {
+        s.events = (long)(n / synth_mean(&s) + 0.5);
+        if (s.events < 1) s.events = 1;
+        snprintf(path, sizeof(path), "%s/icsbench-%ld.ics", dir, n);
+        if ((f = fopen(path, "w")) == NULL) {
+            perror(path);
+            exit(1);
+        }
+        b.events = s.events;
+        b.occurrences = synth_write(f, &s);
+        if (fclose(f) != 0 || stat(path, &sb) != 0) {
+            perror(path);
+            exit(1);
+        }
+        b.bytes = sb.st_size;
+
+        if (b.icsout != NULL) run_program(&b, "icsout", b.icsout, path);
+        if (b.icsout3 != NULL) run_program(&b, "icsout3", b.icsout3, path);
+        run_libics(&b, path);
+        if (!keep) unlink(path);
+        if (n > max / 10) break;
+    }
+    exit(0);
+}
+
+
+/* Function:   seconds()
+ * Purpose:    Reads the monotonic clock.
+ * Returns:    double - seconds from some fixed point
+ */
+double seconds(void){
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/* Function:   run_program()
+ * Parameters: const bench_t *b - the window, runs and current calendar
+ *             const char *name - name to report the program under
+ *             const char *prog - path of icsout or icsout3
+ *             const char *path - calendar to run it on
+ * Purpose:    Runs the program b->runs times with its output sent to
+ *             /dev/null, and prints the best wall time and the largest
+ *             resident size seen, then the time of each step of the best
+ *             run as it reported them on stderr. A run that fails is
+ *             reported on stderr and its line holds "-".
+ */
+void run_program(const bench_t *b, const char *name, const char *prog,
+                 const char *path){
+
+    char start[48], end[48], file[BENCH_PATH_LEN + 8];
+    char stats[BENCH_PATH_LEN + 8], json[BENCH_STATS_LEN] = "";
+    char phase[32], *p;
+    char *args[6];
+    int year, month, day, status, fd, i;
+    double best = -1, t, wall;
+    long rss = 0;
+    ssize_t n;
+    struct rusage ru;
+    pid_t pid;
+
+    civil_from_days(b->from, &year, &month, &day);
+    snprintf(start, sizeof(start), "--start=%d/%d/%d", year, month, day);
+    civil_from_days(b->to, &year, &month, &day);
+    snprintf(end, sizeof(end), "--end=%d/%d/%d", year, month, day);
+    snprintf(file, sizeof(file), "--file=%s", path);
+    snprintf(stats, sizeof(stats), "%s.stats", path);
+    args[0] = (char *)prog;
+    args[1] = start;
+    args[2] = end;
+    args[3] = "--stats=json";
+    args[4] = file;
+    args[5] = NULL;
+
+    for (i = 0; i < b->runs; i++) {
+        fflush(stdout);
+        t = seconds();
+        if ((pid = fork()) == 0) {
+            if ((fd = open("/dev/null", O_WRONLY)) >= 0) dup2(fd, STDOUT_FILENO);
+            fd = open(stats, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd >= 0) dup2(fd, STDERR_FILENO);
+            execv(prog, args);
+            _exit(127);
+        }
+        if (pid < 0 || wait4(pid, &status, 0, &ru) != pid
+            || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "%s: failed on %s\n", prog, path);
+            best = -1;
+            break;
+        }
+        t = seconds() - t;
+        if (ru.ru_maxrss > rss) rss = ru.ru_maxrss;
+        if (best >= 0 && t >= best) continue;
+        best = t;
+        if ((fd = open(stats, O_RDONLY)) >= 0) {
+            n = read(fd, json, sizeof(json) - 1);
+            json[n > 0 ? n : 0] = '\0';
+            close(fd);
+        }
+    }
+    unlink(stats);
+
+    if (best < 0) {
+        printf("%s,%ld,%ld,%lld,%d,total,-,-\n", name, b->occurrences,
+               b->events, b->bytes, b->to - b->from + 1);
+    } else {
+        printf("%s,%ld,%ld,%lld,%d,total,%.6f,%ld\n", name, b->occurrences,
+               b->events, b->bytes, b->to - b->from + 1, best, rss);
+        for (p = json; (p = strstr(p, "{\"name\":\"")) != NULL; p++) {
+            if (sscanf(p, "{\"name\":\"%31[^\"]\",\"wall\":%lf", phase,
+                       &wall) == 2) {
+                printf("%s,%ld,%ld,%lld,%d,%s,%.6f,-\n", name,
+                       b->occurrences, b->events, b->bytes,
+                       b->to - b->from + 1, phase, wall);
+            }
+        }
+    }
+    fflush(stdout);
+}
+
+
+/* Function:   run_libics()
+ * Parameters: const bench_t *b - the window, runs and current calendar
+ *             const char *path - calendar to read
+ * Purpose:    Reads the window with libics b->runs times, as icsout3
+ *             does, and prints the best time of each step: "open" reads
+ *             and indexes the calendar, "query" finds the events in the
+ *             window and seeks its rules there, and "print" makes their
+ *             occurrences and formats it all into /dev/null.
+ */
+void run_libics(const bench_t *b, const char *path){
+
+    static const char *names[3] = {"open", "query", "print"};
+    static outbuf_t out;
+    double best[3] = {-1, -1, -1}, t[4];
+    headers_t headers;
+    ics_iter_t it;
+    ics_t *ics;
+    int fd = open("/dev/null", O_WRONLY);
+    int i, k;
+
+    for (i = 0; i < b->runs; i++) {
+        t[0] = seconds();
+        ics = ics_open((const char * const *)&path, 1, 0);
+        if (ics == NULL) {
+            fprintf(stderr, "libics: failed on %s\n", path);
+            break;
+        }
+        t[1] = seconds();
+        ics_query_range(ics, b->from, b->to, 0, &it);
+        t[2] = seconds();
+        out_init(&out, fd);
+        headers_init(&headers, b->from, b->to);
+        report(&out, &headers, &it);
+        out_flush(&out);
+        t[3] = seconds();
+        headers_free(&headers);
+        ics_iter_free(&it);
+        ics_close(ics);
+
+        for (k = 0; k < 3; k++) {
+            if (best[k] < 0 || t[k + 1] - t[k] < best[k]) {
+                best[k] = t[k + 1] - t[k];
+            }
+        }
+    }
+    if (fd >= 0) close(fd);
+
+    for (k = 0; k < 3 && best[k] >= 0; k++) {
+        printf("libics,%ld,%ld,%lld,%d,%s,%.6f,-\n", b->occurrences,
+               b->events, b->bytes, b->to - b->from + 1, names[k], best[k]);
+    }
+    fflush(stdout);
+}
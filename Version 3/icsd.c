@@ -0,0 +1,391 @@
+/*
+ * icsd.c
+ *
+ * Query daemon. Loads calendars once and answers range queries over a
+ * Unix domain socket, so that callers pay neither process startup nor a
+ * parse per query.
+ *
+ *     icsd --socket=path [--watch] --file=icsfile|dir [--file=icsfile|dir ...]
+ *
+ * Each request is one line:
+ *
+ *     RANGE yyyy/mm/dd yyyy/mm/dd     events starting on those days
+ *     DAY yyyy/mm/dd                  events starting on that day
+ *     QUIT                            close the connection
+ *
+ * The reply is the report icsout3 would print for the same days, or a
+ * line "ERR reason", followed by a line holding a single ".". No line of
+ * a report can be ".", so a client reads up to it. A connection may
+ * send any number of requests.
+ *
+ * Client sockets are non-blocking. What a client's socket will not take
+ * yet is held for it and sent as it reads, and no more of its requests
+ * are read until it has all been sent, so a client that stops reading
+ * holds up no one else.
+ *
+ * The calendars are loaded with libics, which keeps repeating events as
+ * rules and runs them over the days of each request only, so a rule
+ * with no end takes no more memory than any other event. The rest of a
+ * request is a lookup in the day index.
+ *
+ * With --watch the directories of the calendars are watched with inotify,
+ * and a calendar written or moved into place is reloaded between
+ * requests by ics_reload(), which parses only the VEVENTs that changed.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "dates.h"
+#include "emalloc.h"
+#include "headers.h"
+#include "libics.h"
+#include "outbuf.h"
+#include "report.h"
+
+#define MAX_CLIENTS     256
+#define REQUEST_LEN     256
+#define EVENTS_LEN      4096    /* bytes of inotify events read at once */
+#define HEADER_YEARS    50      /* days given a cached heading, from the first event */
+
+typedef struct calendar_t {
+    ics_t      *ics;
+    headers_t   headers;
+} calendar_t;
+
+typedef struct client_t {
+    int         fd;
+    int         quit;      /* asked to close once its replies are sent */
+    held_t      held;      /* replies its socket has not taken yet */
+    size_t      len;
+    char        buf[REQUEST_LEN];
+} client_t;
+
+static volatile sig_atomic_t stop = 0;
+
+void load(calendar_t *, const char **, int, int);
+int listen_on(const char *);
+int watch_paths(const char **, int);
+void reload(calendar_t *, int);
+int serve(calendar_t *, client_t *, outbuf_t *);
+int answer(calendar_t *, const char *, outbuf_t *);
+void query(calendar_t *, int, int, outbuf_t *);
+
+static void on_signal(int sig){
+    (void)sig;
+    stop = 1;
+}
+
+int main(int argc, char *argv[]){
+
+    char *socket_path = NULL;
+    const char **paths = emalloc(argc * sizeof(char *));
+    int npaths = 0;
+    static calendar_t cal;
+    static client_t clients[MAX_CLIENTS];
+    static outbuf_t out;
+    struct pollfd fds[MAX_CLIENTS + 2];
+    struct sigaction sa;
+    client_t *c;
+    int nclients = 0, watch = 0, nfds, status;
+    int listen_fd, notify_fd = -1, fd, i;
+
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--socket=", 9) == 0) {
+            socket_path = argv[i]+9;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch = 1;
+        } else if (strncmp(argv[i], "--file=", 7) == 0) {
+            paths[npaths++] = argv[i]+7;
+        }
+    }
+
+    if (socket_path == NULL || npaths == 0) {
+        fprintf(stderr,
+            "usage: %s --socket=path [--watch] --file=icsfile|dir [--file=icsfile|dir ...]\n",
+            argv[0]);
+        exit(1);
+    }
+
+    /* The watches are set before loading, so no change is missed */
+    if (watch) notify_fd = watch_paths(paths, npaths);
+    load(&cal, paths, npaths, watch);
+    listen_fd = listen_on(socket_path);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    while (!stop) {
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        for (i = 0; i < nclients; i++) {
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = clients[i].held.len > 0 ? POLLOUT : POLLIN;
+        }
+        nfds = nclients + 1;
+        if (notify_fd >= 0) {
+            fds[nfds].fd = notify_fd;
+            fds[nfds++].events = POLLIN;
+        }
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        /* Reloads before answering anything that arrived with the
+         * change */
+        if (notify_fd >= 0 && (fds[nfds - 1].revents & POLLIN)) {
+            reload(&cal, notify_fd);
+        }
+
+        /* Serves clients first, sending on what is held for those that
+         * have it, and dropping those that are done */
+        for (i = nclients - 1; i >= 0; i--) {
+            c = &clients[i];
+            if (fds[i + 1].revents == 0) continue;
+            if (c->held.len > 0) status = out_drain(c->fd, &c->held);
+            else status = serve(&cal, c, &out);
+            if (status != 0 || (c->quit && c->held.len == 0)) {
+                close(c->fd);
+                held_free(&c->held);
+                *c = clients[--nclients];
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) continue;
+            if (nclients == MAX_CLIENTS) {
+                close(fd);
+                continue;
+            }
+            memset(&clients[nclients], 0, sizeof(client_t));
+            clients[nclients++].fd = fd;
+        }
+    }
+
+    for (i = 0; i < nclients; i++) {
+        close(clients[i].fd);
+        held_free(&clients[i].held);
+    }
+    close(listen_fd);
+    if (notify_fd >= 0) close(notify_fd);
+    unlink(socket_path);
+    headers_free(&cal.headers);
+    ics_close(cal.ics);
+    free(paths);
+    exit(0);
+}
+
+
+/* Function:   load()
+ * Parameters: calendar_t *cal - calendar to load into
+ *             const char **paths - calendars, or directories of them
+ *             int count - number of paths
+ *             int watch - whether the calendars will be reloaded
+ * Purpose:    Opens the calendars. Day headings are cached from the
+ *             first event on.
+ */
+void load(calendar_t *cal, const char **paths, int count, int watch){
+
+    int first, last;
+
+    cal->ics = ics_open(paths, count, watch ? ICS_WATCH : 0);
+    if (cal->ics == NULL) exit(1);
+    ics_count(cal->ics, &first, &last);
+    headers_init(&cal->headers, first, first + HEADER_YEARS * 366);
+}
+
+
+/* Function:   watch_paths()
+ * Parameters: const char **paths - calendars, or directories of them
+ *             int count - number of paths
+ * Purpose:    Watches each directory given, and the directory of each
+ *             calendar, for files closed after writing or moved in, as
+ *             editors often save by writing a new file and renaming it
+ *             over the old one. Watching a directory twice is harmless.
+ * Returns:    int - the inotify descriptor, non-blocking
+ */
+int watch_paths(const char **paths, int count){
+
+    struct stat sb;
+    char *dir, *slash;
+    int fd, i;
+
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        perror("inotify_init1");
+        exit(1);
+    }
+    for (i = 0; i < count; i++) {
+        dir = emalloc(strlen(paths[i]) + 2);
+        strcpy(dir, paths[i]);
+        if (stat(paths[i], &sb) != 0 || !S_ISDIR(sb.st_mode)) {
+            slash = strrchr(dir, '/');
+            if (slash == NULL) strcpy(dir, ".");
+            else if (slash == dir) dir[1] = '\0';
+            else *slash = '\0';
+        }
+        if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            perror(dir);
+            exit(1);
+        }
+        free(dir);
+    }
+    return fd;
+}
+
+
+/* Function:   reload()
+ * Parameters: calendar_t *cal - the loaded calendars
+ *             int fd - the inotify descriptor, readable
+ * Purpose:    Drains the pending events, which only say that something
+ *             in a watched directory changed, and has ics_reload() find
+ *             and patch in whichever calendars did.
+ */
+void reload(calendar_t *cal, int fd){
+
+    char buf[EVENTS_LEN]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (read(fd, buf, sizeof(buf)) > 0);
+    if (ics_reload(cal->ics) < 0) {
+        fprintf(stderr, "reload failed, keeping the calendars as they were\n");
+    }
+}
+
+
+/* Function:   listen_on()
+ * Parameters: const char *path - path of the socket
+ * Purpose:    Replaces whatever is at the path with a listening Unix
+ *             domain stream socket.
+ * Returns:    int - the socket
+ */
+int listen_on(const char *path){
+
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        exit(1);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        exit(1);
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        perror(path);
+        exit(1);
+    }
+    return fd;
+}
+
+
+/* Function:   serve()
+ * Parameters: calendar_t *cal - the loaded calendars
+ *             client_t *c - a client with something to read
+ *             outbuf_t *out - buffer to write replies through
+ * Purpose:    Reads what the client sent and answers each complete line,
+ *             holding what its socket will not take yet. A line too long
+ *             to be a request is answered with an error and dropped.
+ *             Lines after a QUIT are not answered, and the client is
+ *             marked to be closed once its replies are sent.
+ * Returns:    int - 0 to keep the connection, or -1 to close it
+ */
+int serve(calendar_t *cal, client_t *c, outbuf_t *out){
+
+    ssize_t n;
+    char *line, *eol;
+
+    n = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len);
+    if (n <= 0) {
+        return n < 0 && (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+    }
+    c->len += n;
+
+    out_init(out, c->fd);
+    out_hold(out, &c->held);
+    line = c->buf;
+    while (!c->quit &&
+           (eol = memchr(line, '\n', c->buf + c->len - line)) != NULL) {
+        *eol = '\0';
+        if (eol > line && eol[-1] == '\r') eol[-1] = '\0';
+        c->quit = answer(cal, line, out) != 0;
+        line = eol + 1;
+    }
+    c->len -= line - c->buf;
+    memmove(c->buf, line, c->len);
+    if (c->len == sizeof(c->buf)) {
+        out_str(out, "ERR request too long\n.\n");
+        c->len = 0;
+    }
+    return out_flush(out);
+}
+
+
+/* Function:   answer()
+ * Parameters: calendar_t *cal - the loaded calendars
+ *             const char *line - one request, without its newline
+ *             outbuf_t *out - buffer to write the reply to
+ * Purpose:    Parses a request and writes its reply, ending in ".".
+ * Returns:    int - 0, or -1 if the client asked to close the connection
+ */
+int answer(calendar_t *cal, const char *line, outbuf_t *out){
+
+    int from_y, from_m, from_d, to_y, to_m, to_d;
+
+    if (sscanf(line, "RANGE %d/%d/%d %d/%d/%d", &from_y, &from_m, &from_d,
+               &to_y, &to_m, &to_d) == 6) {
+        query(cal, days_from_civil(from_y, from_m, from_d),
+              days_from_civil(to_y, to_m, to_d), out);
+    } else if (sscanf(line, "DAY %d/%d/%d", &from_y, &from_m, &from_d) == 3) {
+        query(cal, days_from_civil(from_y, from_m, from_d),
+              days_from_civil(from_y, from_m, from_d), out);
+    } else if (strcmp(line, "QUIT") == 0) {
+        return -1;
+    } else {
+        out_str(out, "ERR unknown request\n");
+    }
+    out_str(out, ".\n");
+    return 0;
+}
+
+
+/* Function:   query()
+ * Parameters: calendar_t *cal - the loaded calendars
+ *             int from - first day to report
+ *             int to - last day to report
+ *             outbuf_t *out - buffer to write the report to
+ * Purpose:    Looks up the events that start in the days and writes the
+ *             report.
+ */
+void query(calendar_t *cal, int from, int to, outbuf_t *out){
+
+    ics_iter_t it;
+
+    ics_query_range(cal->ics, from, to, 0, &it);
+    report(out, &cal->headers, &it);
+    ics_iter_free(&it);
+}
@@ -0,0 +1,69 @@
+/*
+ * icsgen.c
+ *
+ * Writes a synthetic calendar to stdout, the same bytes for the same
+ * arguments, and the number of occurrences in it to stderr.
+ *
+ *     icsgen [--events=n] [--repeat=percent] [--span=days]
+ *            [--summary=len] [--location=len] [--start=yyyy/mm/dd]
+ *            [--days=n] [--seed=n] [--mixed]
+ *
+ * See synth.c for the shape of what is written.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dates.h"
+#include "synth.h"
+
+int main(int argc, char *argv[]){
+
+    synth_t s;
+    int y, m, d, i, bad = 0;
+    long occurrences;
+
+    synth_defaults(&s);
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--events=", 9) == 0) {
+            s.events = atol(argv[i]+9);
+        } else if (strncmp(argv[i], "--repeat=", 9) == 0) {
+            s.repeat = atoi(argv[i]+9);
+        } else if (strncmp(argv[i], "--span=", 7) == 0) {
+            s.span = atoi(argv[i]+7);
+        } else if (strncmp(argv[i], "--summary=", 10) == 0) {
+            s.summary = atoi(argv[i]+10);
+        } else if (strncmp(argv[i], "--location=", 11) == 0) {
+            s.location = atoi(argv[i]+11);
+        } else if (strncmp(argv[i], "--days=", 7) == 0) {
+            s.days = atoi(argv[i]+7);
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            s.seed = strtoull(argv[i]+7, NULL, 10);
+        } else if (sscanf(argv[i], "--start=%d/%d/%d", &y, &m, &d) == 3) {
+            s.first = days_from_civil(y, m, d);
+        } else if (strcmp(argv[i], "--mixed") == 0) {
+            s.mixed = 1;
+        } else {
+            bad = 1;
+        }
+    }
+
+    if (bad || s.events < 0 || s.repeat < 0 || s.repeat > 100 || s.span < 0
+        || s.summary < 0 || s.location < 0 || s.days < 1) {
+        fprintf(stderr,
+            "usage: %s [--events=n] [--repeat=percent] [--span=days] [--summary=len]\n"
+            "       [--location=len] [--start=yyyy/mm/dd] [--days=n] [--seed=n] [--mixed]\n",
+            argv[0]);
+        exit(1);
+    }
+
+    occurrences = synth_write(stdout, &s);
+    if (fflush(stdout) != 0) {
+        perror("write");
+        exit(1);
+    }
+    fprintf(stderr, "%ld events, %ld occurrences\n", s.events, occurrences);
+    exit(0);
+}
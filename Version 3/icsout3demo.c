@@ -10,20 +10,20 @@
 
 #define MAX_LINE_LEN 80
 
-void extract(char *);
+void echo_file(char *);
 
 void print_event(node_t *n, void *arg) {
     assert(n != NULL);
 
     event_t *event = n->val;
 
-    if (strcmp(event->rrule, "") == 0) {
-        printf("EVENT: %s %s '%.10s' '%.10s'\n", event->dtstart,
-            event->dtend, event->summary, event->location);
+    if (event->until == NO_RRULE) {
+        printf("EVENT: %lld %lld %u %u\n", (long long)event->start,
+            (long long)event->end, event->summary, event->location);
     } else {
-        printf("EVENT: %s %s '%.10s' '%.10s' '%.10s'\n", event->dtstart,
-            event->dtend, event->summary, event->location,
-            event->rrule);
+        printf("EVENT: %lld %lld %u %u %lld\n", (long long)event->start,
+            (long long)event->end, event->summary, event->location,
+            (long long)event->until);
     }
 }
 
@@ -121,7 +121,7 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    extract(filename);
+    echo_file(filename);
 /*
  * Showing some simple usage of the linked-list routines.
  */
@@ -133,7 +133,7 @@ int main(int argc, char *argv[])
     exit(0);
 }
 
-void extract(char *filename){
+void echo_file(char *filename){
 
     char *line = NULL;
     size_t size = 0;
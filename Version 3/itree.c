@@ -0,0 +1,284 @@
+/*
+ * itree.c
+ *
+ * Query index over a sorted list of events, kept as columns so that a
+ * query reads only the keys it compares and the ids it hands back, and
+ * never the events themselves. Events that start in a range are found
+ * by binary search on the start keys.
+ *
+ * Events that start before a range but are still going on when it
+ * begins are found by walking an implicit interval tree over blocks of
+ * ITREE_BLOCK events: each range [lo, hi) of blocks is rooted at its
+ * middle block, and maxend holds the largest end key under each root,
+ * so whole subtrees that end too early are skipped. The end keys of a
+ * block that is reached are compared all at once into a bit mask of
+ * hits, with AVX2 or SSE4.2 where the CPU has them, chosen once at
+ * startup, and elsewhere one key at a time. Both take O(log n + k) for
+ * k hits on calendars whose events do not nest deeply, and the keys of
+ * those that do are still read at the speed of memory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "emalloc.h"
+#include "itree.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define AFTER_SIMD
+#endif
+
+/*
+ * Returns the mask of the ITREE_BLOCK keys at ends that are greater
+ * than key, bit i for ends[i].
+ */
+typedef uint64_t (*after_fn)(const int64_t *ends, int64_t key);
+
+
+static uint64_t after_scalar(const int64_t *ends, int64_t key, size_t len) {
+    uint64_t m = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        m |= (uint64_t)(ends[i] > key) << i;
+    }
+    return m;
+}
+
+
+#ifdef AFTER_SIMD
+__attribute__((target("sse4.2")))
+static uint64_t after_sse42(const int64_t *ends, int64_t key) {
+    const __m128i k = _mm_set1_epi64x(key);
+    uint64_t m = 0;
+    __m128i v;
+    int i;
+
+    for (i = 0; i < ITREE_BLOCK; i += 2) {
+        v = _mm_loadu_si128((const __m128i *)(ends + i));
+        m |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(v, k))) << i;
+    }
+    return m;
+}
+
+
+__attribute__((target("avx2")))
+static uint64_t after_avx2(const int64_t *ends, int64_t key) {
+    const __m256i k = _mm256_set1_epi64x(key);
+    uint64_t m = 0;
+    __m256i v;
+    int i;
+
+    for (i = 0; i < ITREE_BLOCK; i += 4) {
+        v = _mm256_loadu_si256((const __m256i *)(ends + i));
+        m |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v, k))) << i;
+    }
+    return m;
+}
+#endif
+
+
+static uint64_t after_block(const int64_t *ends, int64_t key) {
+    return after_scalar(ends, key, ITREE_BLOCK);
+}
+
+
+static after_fn ends_after = after_block;
+
+#ifdef AFTER_SIMD
+__attribute__((constructor))
+static void pick_after(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        ends_after = after_avx2;
+    } else if (__builtin_cpu_supports("sse4.2")) {
+        ends_after = after_sse42;
+    }
+}
+#endif
+
+
+static size_t blocks(size_t count) {
+    return (count + ITREE_BLOCK - 1) / ITREE_BLOCK;
+}
+
+
+/*
+ * Sets maxend for the blocks in [lo, hi) and returns their largest end
+ * key.
+ */
+static int64_t build(itree_t *t, size_t lo, size_t hi) {
+    size_t mid, i, end;
+    int64_t max, sub;
+
+    if (lo >= hi) {
+        return INT64_MIN;
+    }
+    mid = lo + (hi - lo) / 2;
+    max = INT64_MIN;
+    end = (mid + 1) * ITREE_BLOCK < t->count ? (mid + 1) * ITREE_BLOCK
+                                             : t->count;
+    for (i = mid * ITREE_BLOCK; i < end; i++) {
+        if (t->ends[i] > max) max = t->ends[i];
+    }
+    sub = build(t, lo, mid);
+    if (sub > max) max = sub;
+    sub = build(t, mid + 1, hi);
+    if (sub > max) max = sub;
+    t->maxend[mid] = max;
+    return max;
+}
+
+
+void itree_build(itree_t *t, node_t *sorted) {
+    node_t *n;
+    size_t i = 0;
+
+    memset(t, 0, sizeof(itree_t));
+    for (n = sorted; n != NULL; n = n->next) {
+        t->count++;
+    }
+    t->nodes = emalloc((t->count + 1) * sizeof(node_t *));
+    t->starts = emalloc((t->count + 1) * sizeof(int64_t));
+    t->ends = emalloc((t->count + 1) * sizeof(int64_t));
+    t->summaries = emalloc((t->count + 1) * sizeof(uint32_t));
+    t->locations = emalloc((t->count + 1) * sizeof(uint32_t));
+    for (n = sorted; n != NULL; n = n->next, i++) {
+        t->nodes[i] = n;
+        t->starts[i] = n->val->start;
+        t->ends[i] = n->val->end;
+        t->summaries[i] = n->val->summary;
+        t->locations[i] = n->val->location;
+    }
+    t->maxend = emalloc((blocks(t->count) + 1) * sizeof(int64_t));
+    build(t, 0, blocks(t->count));
+}
+
+
+/*
+ * Takes over the columns of events already in order by start key in
+ * place of what the tree held.
+ */
+void itree_adopt(itree_t *t, node_t **nodes, int64_t *starts, int64_t *ends,
+                 uint32_t *summaries, uint32_t *locations, size_t count) {
+    itree_free(t);
+    t->nodes = nodes;
+    t->starts = starts;
+    t->ends = ends;
+    t->summaries = summaries;
+    t->locations = locations;
+    t->count = count;
+    t->maxend = emalloc((blocks(count) + 1) * sizeof(int64_t));
+    build(t, 0, blocks(count));
+}
+
+
+/*
+ * Returns the index of the first event that starts at or after key.
+ */
+static size_t lower_bound(const itree_t *t, int64_t key) {
+    size_t lo = 0, hi = t->count, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (t->starts[mid] < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+
+/*
+ * Finds the events that start in [lo, hi): they are t->nodes[*first]
+ * onwards. Returns how many there are.
+ */
+size_t itree_starting(const itree_t *t, int64_t lo, int64_t hi, size_t *first) {
+    *first = lower_bound(t, lo);
+    return lower_bound(t, hi) - *first;
+}
+
+
+/*
+ * Makes room in hits for a block's worth more after the first n.
+ */
+static void reserve(uint32_t **hits, size_t *cap, size_t n) {
+    if (*cap - n >= ITREE_BLOCK) {
+        return;
+    }
+    *cap = *cap * 2 > n + ITREE_BLOCK ? *cap * 2 : n + ITREE_BLOCK;
+    *hits = realloc(*hits, *cap * sizeof(uint32_t));
+    if (*hits == NULL) {
+        fprintf(stderr, "realloc of %zu hits failed\n", *cap);
+        exit(1);
+    }
+}
+
+
+/*
+ * Adds to hits after the first n, in order, the events among the first
+ * "before" that end after key, looking in the blocks in [lo, hi).
+ * Returns how many hits there are now.
+ */
+static size_t ongoing(const itree_t *t, size_t lo, size_t hi, int64_t key,
+                      size_t before, uint32_t **hits, size_t *cap,
+                      size_t n) {
+    size_t mid, base;
+    uint64_t m;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (t->maxend[mid] <= key) {
+            break;
+        }
+        n = ongoing(t, lo, mid, key, before, hits, cap, n);
+        base = mid * ITREE_BLOCK;
+        if (base >= before) {
+            break;
+        }
+        if (t->count - base >= ITREE_BLOCK) {
+            m = ends_after(t->ends + base, key);
+        } else {
+            m = after_scalar(t->ends + base, key, t->count - base);
+        }
+        if (before - base < ITREE_BLOCK) {
+            m &= ((uint64_t)1 << (before - base)) - 1;
+        }
+        if (m != 0) {
+            reserve(hits, cap, n);
+        }
+        for (; m != 0; m &= m - 1) {
+            (*hits)[n++] = (uint32_t)(base + __builtin_ctzll(m));
+        }
+        lo = mid + 1;
+    }
+    return n;
+}
+
+
+/*
+ * Stores in *hits, in order, the index of every event among the first
+ * "before" that ends after key, growing it with realloc() as they are
+ * found, so that it only ever holds about as many as there are; *cap is
+ * its size. Called with the index of the first event starting at or
+ * after key, these are the events still going on at key. Returns how
+ * many there are.
+ */
+size_t itree_ongoing(const itree_t *t, int64_t key, size_t before,
+                     uint32_t **hits, size_t *cap) {
+    return ongoing(t, 0, blocks(t->count), key, before, hits, cap, 0);
+}
+
+
+void itree_free(itree_t *t) {
+    free(t->nodes);
+    free(t->starts);
+    free(t->ends);
+    free(t->summaries);
+    free(t->locations);
+    free(t->maxend);
+    memset(t, 0, sizeof(itree_t));
+}
@@ -0,0 +1,34 @@
+#ifndef _ITREE_H_
+#define _ITREE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "listy.h"
+
+/*
+ * Events sorted by start key, held as columns: the node of each event,
+ * its start and end keys and the string ids of its summary and location.
+ * maxend holds the largest end key of each subtree of the implicit
+ * binary tree over blocks of ITREE_BLOCK events (the middle block of a
+ * range is the root of that range).
+ */
+#define ITREE_BLOCK     64
+
+typedef struct itree_t {
+    node_t    **nodes;
+    int64_t    *starts;
+    int64_t    *ends;
+    uint32_t   *summaries;
+    uint32_t   *locations;
+    int64_t    *maxend;
+    size_t      count;
+} itree_t;
+
+void    itree_build(itree_t *, node_t *sorted);
+void    itree_adopt(itree_t *, node_t **, int64_t *starts, int64_t *ends,
+                    uint32_t *summaries, uint32_t *locations, size_t count);
+size_t  itree_starting(const itree_t *, int64_t lo, int64_t hi, size_t *first);
+size_t  itree_ongoing(const itree_t *, int64_t key, size_t before,
+                      uint32_t **hits, size_t *cap);
+void    itree_free(itree_t *);
+#endif
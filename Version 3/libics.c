@@ -0,0 +1,1728 @@
+/*
+ * libics.c
+ *
+ * Calendars as a library: ics_open() reads every file once, on a pool
+ * of threads, into a single sorted array of events, and the query
+ * functions hand back iterators over it, leaving what to do with the
+ * events to the caller. icsout3 and icsd are both built on it.
+ *
+ * A repeating event is stored once, as written, and kept in a list of
+ * rules besides, with an itree over the days each rule is going on.
+ * Its other occurrences are never stored: a query finds the rules going
+ * on by its days in that itree and seeks each one to its first day
+ * there with rrule_seek(), and ics_next() draws the occurrences one at
+ * a time with rrule_next() from a heap of the rules, merged with the
+ * stored events. A rule with no end so costs what any other event does
+ * until a query reaches its days.
+ *
+ * Events with equal starts come in the order icsout gives them: the
+ * events as written first, in file order, then the occurrences of
+ * repeating events, in the file order of their rules. merge_runs()
+ * keeps the runs in file order, a watched calendar compares the ranks
+ * of blocks instead, and ics_next() takes a stored event ahead of an
+ * occurrence that starts at the same time.
+ *
+ * Besides the itree, the array is indexed by day: days[d] is the index
+ * of the first event starting on or after the d-th day of the calendar,
+ * so the events of any day, or run of days, are found with two loads
+ * in O(1) whatever the size of the calendar. Calendars spanning more
+ * than MAX_INDEX_DAYS fall back to binary search in the itree.
+ *
+ * Opened with ICS_WATCH, each calendar is read one VEVENT block at a
+ * time and every block is hashed; events carry the id of their block.
+ * ics_reload() rehashes a calendar that has changed, parses only the
+ * blocks whose hash it has not seen before, drops the events of the
+ * blocks that are gone, and merges the two into the sorted array
+ * without sorting it again. Ties are kept in file order by each block's
+ * rank. Dropped events stay in their arenas until there are more of
+ * them than live ones, when the whole calendar is opened afresh.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "arena.h"
+#include "cache.h"
+#include "dates.h"
+#include "emalloc.h"
+#include "ics.h"
+#include "itree.h"
+#include "libics.h"
+#include "listy.h"
+#include "parse.h"
+#include "reader.h"
+#include "rrule.h"
+#include "stats.h"
+#include "strtab.h"
+
+#define MAX_THREADS     64
+#define MAX_INDEX_DAYS  (1 << 21)   /* about 5700 years, 8MB of index */
+#ifndef CHUNK_LEN
+#define CHUNK_LEN       (8 * 1024 * 1024)   /* bytes of a file parsed as one run */
+#endif
+
+/* A file, or a piece of a large one, parsed into its own arena and
+ * string table */
+typedef struct run_t {
+    reader_t    in;
+    cache_t    *cache;     /* saved events to read instead of in, or NULL */
+    int         file;      /* index of the calendar the run is from */
+    int         keep;      /* whether to keep the parsed events */
+    arena_t     arena;
+    strtab_t    strings;
+    event_t   **events;    /* events as parsed, if kept for the index */
+    uint32_t    nevents;
+    uint64_t   *hashes;    /* of its blocks in order, with ICS_WATCH */
+    uint32_t    nblocks;
+    uint32_t    cap;
+    node_t     *head;      /* sorted events of the run */
+    event_t   **rules;     /* its repeating events, in file order */
+    uint32_t    nrules;
+    stats_t     stats;     /* with ICS_STATS */
+} run_t;
+
+/* Runs shared out to the worker threads, next one first come first served */
+typedef struct pool_t {
+    run_t          *runs;
+    int             count;
+    int             next;
+    int             flags;     /* ICS_WATCH and ICS_STATS of ics_open() */
+    pthread_mutex_t lock;
+} pool_t;
+
+/* A VEVENT of a watched calendar, as it was last read */
+typedef struct block_t {
+    uint64_t    hash;
+    uint64_t    rank;      /* file << 32 | position in the file */
+    int         live;      /* 0 once it is no longer in the file */
+} block_t;
+
+/* A watched calendar: the file last read, and its blocks in order */
+typedef struct watch_t {
+    dev_t           dev;
+    ino_t           ino;
+    off_t           size;
+    struct timespec mtime;
+    uint32_t       *blocks;
+    uint32_t        nblocks;
+} watch_t;
+
+/* A rule set going by a query: the occurrence it is on, ahead of the
+ * ones still to come */
+typedef struct repeat_t {
+    occur_t     occur;
+    int64_t     start;
+    uint32_t    rule;      /* index in ics->rules, which breaks ties */
+} repeat_t;
+
+/* The days a rule is going on, for index_rules() to sort */
+typedef struct reach_t {
+    int64_t     first;
+    int64_t     end;
+    uint32_t    rule;
+} reach_t;
+
+struct ics_t {
+    int         flags;
+    char      **paths;     /* calendars, directories expanded */
+    int         npaths;
+    cache_t    *caches;    /* mapped sidecar indexes the events live in */
+    run_t      *runs;      /* arenas of the events and nodes */
+    int         nruns;
+    strtab_t    strings;
+    itree_t     tree;      /* every event as written, by start key */
+    event_t   **rules;     /* the repeating ones, in file order */
+    uint32_t    nrules;
+    itree_t     spans;     /* the days each rule is going on, by first day */
+    uint32_t   *order;     /* index in rules of each of the spans */
+    int32_t     first;     /* day of days[0] */
+    int32_t     ndays;     /* 0 if the calendar is not indexed by day */
+    uint32_t   *days;
+    watch_t    *watch;     /* one per path, with ICS_WATCH */
+    uint32_t   *ids;       /* block of each event in the itree */
+    block_t    *blocks;    /* by id */
+    uint32_t    nblocks;
+    uint32_t    cap;
+    arena_t     arena;     /* events added by ics_reload() */
+    size_t      garbage;   /* events it has dropped */
+    stats_t    *stats;     /* with ICS_STATS, of ics_open() */
+};
+
+static int add_path(char ***, int *, int *, const char *);
+static run_t *open_runs(char **, int, reader_t *, cache_t *, int *);
+static void save_cache(const char *, run_t *, int, int);
+static node_t *load_cache(run_t *);
+static void parse_files(run_t *, int, int);
+static void *parse_worker(void *);
+static void parse_run(run_t *, int);
+static void add_runs(stats_t *, const run_t *, int, stat_clock_t *);
+static void adopt_strings(run_t *, strtab_t *);
+static void index_days(ics_t *);
+static void index_rules(ics_t *);
+static size_t starting(const ics_t *, int, int, size_t *);
+static void find_written(const ics_t *, int, int, int, ics_iter_t *);
+static void seek_rules(const ics_t *, int, int, int, ics_iter_t *);
+static int seek_rule(const ics_t *, repeat_t *, uint32_t, int, int, int);
+static void carry_rules(ics_sweep_t *, int, int);
+static void draw_rules(ics_sweep_t *, int, ics_iter_t *);
+static size_t passed(const repeat_t *, size_t, size_t, int64_t, size_t **,
+                     size_t *, size_t);
+static void sift(repeat_t *, size_t, size_t);
+static void rise(repeat_t *, size_t);
+static void release(ics_t *);
+static int reopen(ics_t *);
+static int reload_file(ics_t *, int, const struct stat *, node_t **);
+static void patch(ics_t *, node_t *);
+static void rank_rules(ics_t *, node_t *);
+static node_t *extract_blocks(run_t *);
+static void adopt_blocks(ics_t *);
+static uint32_t new_block(ics_t *, uint64_t);
+static void watch_file(watch_t *, const struct stat *);
+static uint64_t hash_block(const reader_t *);
+
+
+/* Function:   ics_open()
+ * Parameters: const char * const *paths - calendars, or directories of
+ *                                         them
+ *             int count - number of paths
+ *             int flags - ICS_INDEX to use sidecar indexes, ICS_WATCH
+ *                         to allow ics_reload(), ICS_STATS to keep
+ *                         statistics for ics_stats()
+ * Purpose:    Cuts the calendars into runs, parses them in parallel and
+ *             merges the runs into one sorted array indexed by day, with
+ *             the repeating events gathered as rules for the queries to
+ *             run. No occurrence is made here. With ICS_INDEX
+ *             a calendar with a valid index is read from it, and one
+ *             without gets one written; ICS_WATCH, which needs the text
+ *             of every VEVENT, turns it off.
+ * Returns:    ics_t *ics - the calendar, to be freed with ics_close(), or
+ *             NULL if a path could not be read
+ */
+ics_t *ics_open(const char * const *paths, int count, int flags){
+
+    uint64_t blocks = emalloc_count();
+    ics_t *ics = emalloc(sizeof(ics_t));
+    reader_t *files;
+    node_t **heads;
+    struct stat sb;
+    stat_clock_t clock;
+    uint32_t nrules = 0;
+    int cap = 0, i;
+
+    if (flags & ICS_WATCH) flags &= ~ICS_INDEX;
+    memset(ics, 0, sizeof(ics_t));
+    if (flags & ICS_STATS) {
+        ics->stats = emalloc(sizeof(stats_t));
+        memset(ics->stats, 0, sizeof(stats_t));
+        stats_start(&clock);
+    }
+    ics->flags = flags;
+    for (i = 0; i < count; i++) {
+        if (add_path(&ics->paths, &ics->npaths, &cap, paths[i]) != 0) {
+            ics_close(ics);
+            return NULL;
+        }
+    }
+
+    /* Files are noted before they are read, so that a change made
+     * while they are is seen by the next ics_reload() */
+    if (flags & ICS_WATCH) {
+        ics->watch = emalloc((ics->npaths + 1) * sizeof(watch_t));
+        memset(ics->watch, 0, (ics->npaths + 1) * sizeof(watch_t));
+        for (i = 0; i < ics->npaths; i++) {
+            if (stat(ics->paths[i], &sb) == 0) watch_file(&ics->watch[i], &sb);
+        }
+    }
+
+    files = emalloc((ics->npaths + 1) * sizeof(reader_t));
+    ics->caches = emalloc((ics->npaths + 1) * sizeof(cache_t));
+    memset(ics->caches, 0, (ics->npaths + 1) * sizeof(cache_t));
+    ics->runs = open_runs(ics->paths, ics->npaths, files,
+                          flags & ICS_INDEX ? ics->caches : NULL,
+                          &ics->nruns);
+    if (ics->runs == NULL) {
+        for (i = 0; i < ics->npaths; i++) reader_close(&files[i]);
+        free(files);
+        ics_close(ics);
+        return NULL;
+    }
+
+    if (ics->stats) stats_lap(ics->stats, STAT_READ, &clock);
+    parse_files(ics->runs, ics->nruns, flags);
+    if (ics->stats) add_runs(ics->stats, ics->runs, ics->nruns, &clock);
+    for (i = 0; (flags & ICS_INDEX) && i < ics->npaths; i++) {
+        if (ics->caches[i].base == NULL) {
+            save_cache(ics->paths[i], ics->runs, ics->nruns, i);
+        }
+    }
+    if (ics->stats) stats_lap(ics->stats, STAT_INDEX, &clock);
+
+    heads = emalloc((ics->nruns + 1) * sizeof(node_t *));
+    for (i = 0; i < ics->nruns; i++) {
+        adopt_strings(&ics->runs[i], &ics->strings);
+        heads[i] = ics->runs[i].head;
+        nrules += ics->runs[i].nrules;
+    }
+    ics->rules = emalloc((nrules + 1) * sizeof(event_t *));
+    for (i = 0; i < ics->nruns; i++) {
+        memcpy(ics->rules + ics->nrules, ics->runs[i].rules,
+               ics->runs[i].nrules * sizeof(event_t *));
+        ics->nrules += ics->runs[i].nrules;
+    }
+    index_rules(ics);
+    for (i = 0; i < ics->npaths; i++) reader_close(&files[i]);
+    free(files);
+    if (flags & ICS_WATCH) adopt_blocks(ics);
+
+    itree_build(&ics->tree, merge_runs(heads, ics->nruns));
+    free(heads);
+    if (flags & ICS_WATCH) {
+        ics->ids = emalloc((ics->tree.count + 1) * sizeof(uint32_t));
+        for (i = 0; i < (int)ics->tree.count; i++) {
+            ics->ids[i] = ics->tree.nodes[i]->val->block;
+        }
+    }
+    if (ics->stats) stats_lap(ics->stats, STAT_SORT, &clock);
+    index_days(ics);
+    if (ics->stats) {
+        stats_lap(ics->stats, STAT_INDEX, &clock);
+        ics->stats->allocations = emalloc_count() - blocks;
+    }
+    return ics;
+}
+
+
+/* Function:   ics_close()
+ * Parameters: ics_t *ics - a calendar from ics_open(), or NULL
+ * Purpose:    Frees the calendar and everything its events point to.
+ */
+void ics_close(ics_t *ics){
+    if (ics == NULL) return;
+    release(ics);
+    free(ics);
+}
+
+
+/* Function:   release()
+ * Parameters: ics_t *ics - a calendar
+ * Purpose:    Frees everything the calendar holds but the ics_t itself.
+ */
+static void release(ics_t *ics){
+
+    int i;
+
+    itree_free(&ics->tree);
+    itree_free(&ics->spans);
+    free(ics->order);
+    free(ics->days);
+    for (i = 0; ics->runs != NULL && i < ics->nruns; i++) {
+        arena_free(&ics->runs[i].arena);
+    }
+    for (i = 0; i < ics->npaths; i++) {
+        if (ics->caches != NULL) cache_close(&ics->caches[i]);
+        free(ics->paths[i]);
+    }
+    strtab_free(&ics->strings);
+    for (i = 0; ics->watch != NULL && i < ics->npaths; i++) {
+        free(ics->watch[i].blocks);
+    }
+    arena_free(&ics->arena);
+    free(ics->runs);
+    free(ics->caches);
+    free(ics->paths);
+    free(ics->watch);
+    free(ics->ids);
+    free(ics->blocks);
+    free(ics->rules);
+    free(ics->stats);
+}
+
+
+/* Function:   ics_count()
+ * Parameters: const ics_t *ics - a calendar
+ *             int *first - set to the day the first event starts on
+ *             int *last - set to the day the last event starts on
+ * Purpose:    Describes what the calendar holds. Both days are 0 if it
+ *             holds nothing.
+ * Returns:    size_t count - number of events as written
+ */
+size_t ics_count(const ics_t *ics, int *first, int *last){
+
+    const itree_t *t = &ics->tree;
+
+    *first = t->count > 0 ? key_day(t->starts[0]) : 0;
+    *last = t->count > 0 ? key_day(t->starts[t->count - 1]) : 0;
+    return t->count;
+}
+
+
+/* Function:   ics_stats()
+ * Parameters: const ics_t *ics - a calendar
+ *             stats_t *stats - set to what opening it took and made
+ * Purpose:    Hands back the statistics of ics_open(): the time of each
+ *             step up to the day index, the lines, bytes and VEVENTs,
+ *             and the blocks it had of emalloc(), arena slabs among
+ *             them. With several runs parsed on several threads, the
+ *             wall time of parsing and sorting them is how long that
+ *             took from start to end, and their CPU time is added up
+ *             over the threads. The queries add to them as they go:
+ *             "filter" is the time spent finding the events as written,
+ *             "expand" the time spent seeking rules to their days, and
+ *             "generated" counts the occurrences read from freed
+ *             iterators. All zero unless the calendar was opened with
+ *             ICS_STATS, whose queries must not run at the same time.
+ */
+void ics_stats(const ics_t *ics, stats_t *stats){
+
+    if (ics->stats != NULL) *stats = *ics->stats;
+    else memset(stats, 0, sizeof(stats_t));
+}
+
+
+/* Function:   ics_query_range()
+ * Parameters: const ics_t *ics - a calendar
+ *             int from - first day
+ *             int to - last day
+ *             int flags - ICS_OVERLAP to also find events that started
+ *                         before from and are still going on, which come
+ *                         first
+ *             ics_iter_t *it - set to the events found
+ * Purpose:    Finds the events starting on the days, in order by start
+ *             and for equal starts as icsout orders them, without copying
+ *             them, and sets the rules that repeat on the days going.
+ *             The iterator must be freed with ics_iter_free().
+ */
+void ics_query_range(const ics_t *ics, int from, int to, int flags,
+                     ics_iter_t *it){
+
+    stat_clock_t clock;
+
+    memset(it, 0, sizeof(ics_iter_t));
+    it->ics = ics;
+    if (from < ICS_MIN_DAY) from = ICS_MIN_DAY;
+    if (to > ICS_MAX_DAY) to = ICS_MAX_DAY;
+    if (from > to) return;
+
+    if (ics->stats) stats_start(&clock);
+    find_written(ics, from, to, flags, it);
+    if (ics->stats) stats_lap(ics->stats, STAT_FILTER, &clock);
+    seek_rules(ics, from, to, flags, it);
+    if (ics->stats) stats_lap(ics->stats, STAT_EXPAND, &clock);
+}
+
+
+/* Function:   ics_sweep_init()
+ * Parameters: ics_sweep_t *sw - set to a sweep of the calendar
+ *             const ics_t *ics - a calendar
+ *             int flags - ICS_OVERLAP, as for ics_query_range()
+ * Purpose:    Starts a sweep: queries of many ranges by ics_sweep_range()
+ *             in order by first day, which carry the heap of rules on
+ *             from each range to the next instead of seeking them all
+ *             again. It must be freed with ics_sweep_free(), and is
+ *             invalid after ics_reload().
+ */
+void ics_sweep_init(ics_sweep_t *sw, const ics_t *ics, int flags){
+    memset(sw, 0, sizeof(ics_sweep_t));
+    sw->ics = ics;
+    sw->flags = flags;
+    sw->from = ICS_MIN_DAY;
+}
+
+
+/* Function:   ics_sweep_range()
+ * Parameters: ics_sweep_t *sw - a sweep
+ *             int from - first day, no earlier than that of the range
+ *                        before for the sweep to carry on
+ *             int to - last day
+ *             ics_iter_t *it - set to the events found
+ * Purpose:    Finds what ics_query_range() would. The rules passed by
+ *             from are sought again from there and those that start by
+ *             to are added, so that across the sweep each rule is added
+ *             once and only sought again when a range passes its next
+ *             occurrence; the iterator gets a copy of those with one by
+ *             to. A range that starts before the one ahead of it is
+ *             queried on its own instead.
+ */
+void ics_sweep_range(ics_sweep_t *sw, int from, int to, ics_iter_t *it){
+
+    const ics_t *ics = sw->ics;
+    stat_clock_t clock;
+
+    if (from < ICS_MIN_DAY) from = ICS_MIN_DAY;
+    if (to > ICS_MAX_DAY) to = ICS_MAX_DAY;
+    if (from < sw->from || from > to) {
+        ics_query_range(ics, from, to, sw->flags, it);
+        return;
+    }
+    memset(it, 0, sizeof(ics_iter_t));
+    it->ics = ics;
+    sw->from = from;
+
+    if (ics->stats) stats_start(&clock);
+    find_written(ics, from, to, sw->flags, it);
+    if (ics->stats) stats_lap(ics->stats, STAT_FILTER, &clock);
+    carry_rules(sw, from, to);
+    draw_rules(sw, to, it);
+    if (ics->stats) stats_lap(ics->stats, STAT_EXPAND, &clock);
+}
+
+
+/* Function:   ics_sweep_free()
+ * Parameters: ics_sweep_t *sw - a sweep
+ * Purpose:    Frees what the sweep holds.
+ */
+void ics_sweep_free(ics_sweep_t *sw){
+    free(sw->heap);
+    free(sw->found);
+    memset(sw, 0, sizeof(ics_sweep_t));
+}
+
+
+/* Function:   ics_events_for_day()
+ * Parameters: const ics_t *ics - a calendar
+ *             int day - the day
+ *             ics_iter_t *it - set to the events found
+ * Purpose:    Finds the events starting on one day, in O(1) from the
+ *             day index.
+ */
+void ics_events_for_day(const ics_t *ics, int day, ics_iter_t *it){
+    ics_query_range(ics, day, day, 0, it);
+}
+
+
+/* Function:   ics_next()
+ * Parameters: ics_iter_t *it - an iterator from a query
+ *             ics_event_t *event - set to the next event
+ * Purpose:    Steps through the events found by a query: the next
+ *             stored event, or the occurrence at the top of the heap of
+ *             rules if that starts earlier, which is then replaced by
+ *             its rule's next. The strings stay valid until the calendar
+ *             is closed.
+ * Returns:    int - 1 if an event was read, or 0 at the end
+ */
+int ics_next(ics_iter_t *it, ics_event_t *event){
+
+    const itree_t *t = &it->ics->tree;
+    repeat_t *top = it->nrepeats > 0 ? it->repeats : NULL;
+    const event_t *e;
+    size_t i;
+
+    if (it->pos < it->count) {
+        i = it->pos < it->nhits ? it->hits[it->pos]
+                                : it->first + it->pos - it->nhits;
+        if (top == NULL || t->starts[i] <= top->start) {
+            it->pos++;
+            event->start = t->starts[i];
+            event->end = t->ends[i];
+            event->summary = strtab_get(&it->ics->strings, t->summaries[i]);
+            event->location = strtab_get(&it->ics->strings, t->locations[i]);
+            return 1;
+        }
+    }
+    if (top == NULL) return 0;
+
+    e = it->ics->rules[top->rule];
+    event->start = top->start;
+    event->end = top->start + (e->end - e->start);
+    event->summary = strtab_get(&it->ics->strings, e->summary);
+    event->location = strtab_get(&it->ics->strings, e->location);
+    it->generated++;
+    if (!rrule_next(&top->occur, &top->start)) {
+        *top = it->repeats[--it->nrepeats];
+    }
+    sift(it->repeats, it->nrepeats, 0);
+    return 1;
+}
+
+
+/* Function:   ics_iter_free()
+ * Parameters: ics_iter_t *it - an iterator from a query
+ * Purpose:    Frees whatever the query allocated for the iterator.
+ */
+void ics_iter_free(ics_iter_t *it){
+    if (it->ics != NULL && it->ics->stats != NULL) {
+        it->ics->stats->generated += it->generated;
+    }
+    free(it->hits);
+    free(it->repeats);
+    memset(it, 0, sizeof(ics_iter_t));
+}
+
+
+/* Function:   ics_reload()
+ * Parameters: ics_t *ics - a calendar opened with ICS_WATCH
+ * Purpose:    Rereads the calendars whose file has changed since it was
+ *             last read, by device, inode, size or modification time,
+ *             patching the sorted array with the VEVENTs added and
+ *             removed. Unchanged VEVENTs are neither parsed nor sorted
+ *             again, so the cost beyond hashing the changed files is in
+ *             proportion to the edit. A file that cannot be read is left
+ *             as it was. Iterators from before the call are invalid.
+ * Returns:    int - number of VEVENTs added, removed or moved, or -1 if
+ *             the calendar is not watched or could not be opened afresh
+ */
+int ics_reload(ics_t *ics){
+
+    node_t *added = NULL;
+    struct stat sb;
+    watch_t *w;
+    int i, n, changed = 0;
+
+    if (ics->watch == NULL) return -1;
+    for (i = 0; i < ics->npaths; i++) {
+        w = &ics->watch[i];
+        if (stat(ics->paths[i], &sb) != 0) continue;
+        if (sb.st_dev == w->dev && sb.st_ino == w->ino &&
+            sb.st_size == w->size && sb.st_mtim.tv_sec == w->mtime.tv_sec &&
+            sb.st_mtim.tv_nsec == w->mtime.tv_nsec) {
+            continue;
+        }
+        n = reload_file(ics, i, &sb, &added);
+        if (n > 0) changed += n;
+    }
+    if (changed == 0) return 0;
+
+    patch(ics, added);
+    rank_rules(ics, added);
+    if (ics->garbage > ics->tree.count && ics->garbage > 1024) {
+        if (reopen(ics) != 0) return -1;
+    }
+    return changed;
+}
+
+
+/* Function:   index_days()
+ * Parameters: ics_t *ics - a calendar with its itree built
+ * Purpose:    Builds the day index in one pass over the sorted starts,
+ *             unless the calendar spans too many days for it.
+ */
+static void index_days(ics_t *ics){
+
+    const itree_t *t = &ics->tree;
+    int32_t last, d;
+    size_t i = 0;
+
+    if (t->count == 0 || t->count > UINT32_MAX) return;
+    ics->first = key_day(t->starts[0]);
+    last = key_day(t->starts[t->count - 1]);
+    if ((int64_t)last - ics->first >= MAX_INDEX_DAYS) return;
+
+    ics->ndays = last - ics->first + 1;
+    ics->days = emalloc((ics->ndays + 1) * sizeof(uint32_t));
+    for (d = 0; d <= ics->ndays; d++) {
+        while (i < t->count && key_day(t->starts[i]) < ics->first + d) i++;
+        ics->days[d] = (uint32_t)i;
+    }
+}
+
+
+/* qsort() order of reaches: by first day */
+static int by_first(const void *a, const void *b){
+    const reach_t *x = (const reach_t *)a;
+    const reach_t *y = (const reach_t *)b;
+
+    return (x->first > y->first) - (x->first < y->first);
+}
+
+
+/* Function:   index_rules()
+ * Parameters: ics_t *ics - a calendar with its rules gathered
+ * Purpose:    Builds an itree over the days the rules are going on, in
+ *             place of what it held: each starts on the day of its
+ *             first occurrence and ends the day after its last one
+ *             could still be going on, which is as early as any query
+ *             can pass it over.
+ */
+static void index_rules(ics_t *ics){
+
+    reach_t *spans = emalloc((ics->nrules + 1) * sizeof(reach_t));
+    int64_t *starts, *ends, len;
+    const event_t *e;
+    uint32_t i;
+
+    for (i = 0; i < ics->nrules; i++) {
+        e = ics->rules[i];
+        len = e->end - e->start;
+        spans[i].first = key_day(e->start);
+        spans[i].end = (int64_t)key_day(e->until) + 2;
+        if (len > 0) spans[i].end += len / SECS_PER_DAY;
+        spans[i].rule = i;
+    }
+    qsort(spans, ics->nrules, sizeof(reach_t), by_first);
+    starts = emalloc((ics->nrules + 1) * sizeof(int64_t));
+    ends = emalloc((ics->nrules + 1) * sizeof(int64_t));
+    free(ics->order);
+    ics->order = emalloc((ics->nrules + 1) * sizeof(uint32_t));
+    for (i = 0; i < ics->nrules; i++) {
+        starts[i] = spans[i].first;
+        ends[i] = spans[i].end;
+        ics->order[i] = spans[i].rule;
+    }
+    free(spans);
+    itree_adopt(&ics->spans, NULL, starts, ends, NULL, NULL, ics->nrules);
+}
+
+
+/* Function:   starting()
+ * Parameters: const ics_t *ics - a calendar
+ *             int from - first day, no earlier than ICS_MIN_DAY
+ *             int to - last day, no later than ICS_MAX_DAY
+ *             size_t *first - set to the index of the first event
+ *                             starting on or after from
+ * Purpose:    Finds the events starting on the days from the day index,
+ *             or by binary search if there is none.
+ * Returns:    size_t count - number of events found
+ */
+static size_t starting(const ics_t *ics, int from, int to, size_t *first){
+
+    int32_t last = ics->first + ics->ndays - 1;
+
+    if (ics->days == NULL) {
+        return itree_starting(&ics->tree, (int64_t)from * SECS_PER_DAY,
+                              (int64_t)(to + 1) * SECS_PER_DAY, first);
+    }
+    if (from < ics->first) from = ics->first;
+    if (to > last) to = last;
+    if (from > to) {
+        *first = from > last ? ics->tree.count : 0;
+        return 0;
+    }
+    *first = ics->days[from - ics->first];
+    return ics->days[to - ics->first + 1] - *first;
+}
+
+
+/* Whether repeat a comes out of the heap before repeat b */
+static int sooner(const repeat_t *a, const repeat_t *b){
+    return a->start < b->start || (a->start == b->start && a->rule < b->rule);
+}
+
+
+/* Function:   sift()
+ * Parameters: repeat_t *heap - a binary min-heap of rules, by sooner()
+ *             size_t n - number of rules in it
+ *             size_t i - index of the one that may be out of place
+ * Purpose:    Moves a rule down the heap until neither child is sooner.
+ */
+static void sift(repeat_t *heap, size_t n, size_t i){
+
+    repeat_t tmp;
+    size_t c;
+
+    while ((c = 2 * i + 1) < n) {
+        if (c + 1 < n && sooner(&heap[c + 1], &heap[c])) c++;
+        if (!sooner(&heap[c], &heap[i])) break;
+        tmp = heap[i];
+        heap[i] = heap[c];
+        heap[c] = tmp;
+        i = c;
+    }
+}
+
+
+/* Function:   rise()
+ * Parameters: repeat_t *heap - a binary min-heap of rules, by sooner()
+ *             size_t i - index of the one that may be out of place
+ * Purpose:    Moves a rule up the heap until its parent is not later.
+ */
+static void rise(repeat_t *heap, size_t i){
+
+    repeat_t tmp;
+
+    while (i > 0 && sooner(&heap[i], &heap[(i - 1) / 2])) {
+        tmp = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+
+/* Function:   find_written()
+ * Parameters: const ics_t *ics - a calendar
+ *             int from - first day, no earlier than ICS_MIN_DAY
+ *             int to - last day, no later than ICS_MAX_DAY
+ *             int flags - ICS_OVERLAP to also find the events still
+ *                         going on at the start of from
+ *             ics_iter_t *it - the query's iterator
+ * Purpose:    Sets the iterator to the events as written that a query
+ *             of the days finds.
+ */
+static void find_written(const ics_t *ics, int from, int to, int flags,
+                         ics_iter_t *it){
+
+    size_t cap = 0;
+
+    it->count = starting(ics, from, to, &it->first);
+    if (flags & ICS_OVERLAP) {
+        it->nhits = itree_ongoing(&ics->tree, (int64_t)from * SECS_PER_DAY,
+                                  it->first, &it->hits, &cap);
+        it->count += it->nhits;
+    }
+}
+
+
+/* Function:   seek_rules()
+ * Parameters: const ics_t *ics - a calendar
+ *             int from - first day, no earlier than ICS_MIN_DAY
+ *             int to - last day, no later than ICS_MAX_DAY
+ *             int flags - ICS_OVERLAP to also find the occurrences still
+ *                         going on at the start of from
+ *             ics_iter_t *it - the query's iterator
+ * Purpose:    Seeks every rule that repeats on the days to its first
+ *             occurrence there with seek_rule(), and heaps those that
+ *             have one for ics_next(). The rules are found in the itree
+ *             of their spans, so that only those going on by the days
+ *             are looked at. The heap holds a rule each, however many
+ *             occurrences there are.
+ */
+static void seek_rules(const ics_t *ics, int from, int to, int flags,
+                       ics_iter_t *it){
+
+    uint32_t *hits = NULL;
+    size_t n = 0, cap = 0, nhits, before, h;
+
+    before = itree_starting(&ics->spans, INT64_MIN, (int64_t)to + 1, &h);
+    nhits = itree_ongoing(&ics->spans, from, before, &hits, &cap);
+    if (nhits > 0) {
+        it->repeats = emalloc(nhits * sizeof(repeat_t));
+    }
+    for (h = 0; h < nhits; h++) {
+        n += seek_rule(ics, &it->repeats[n], ics->order[hits[h]], from, to,
+                       flags);
+    }
+    free(hits);
+    it->nrepeats = n;
+    for (h = n / 2; h-- > 0;) sift(it->repeats, n, h);
+}
+
+
+/* Function:   seek_rule()
+ * Parameters: const ics_t *ics - a calendar
+ *             repeat_t *r - set to the rule's first occurrence by from
+ *             uint32_t rule - index of the rule in ics->rules
+ *             int from - first day, no earlier than ICS_MIN_DAY
+ *             int to - last day, no later than ICS_MAX_DAY
+ *             int flags - ICS_OVERLAP to also take an occurrence still
+ *                         going on at the start of from
+ * Purpose:    Seeks a rule to the days with rrule_seek() and steps it
+ *             with rrule_next() to its first occurrence there. With
+ *             ICS_OVERLAP it is sought from earlier by the length of its
+ *             event, and occurrences over by the start of from are
+ *             passed.
+ * Returns:    int - 1 if it has an occurrence by to, or 0
+ */
+static int seek_rule(const ics_t *ics, repeat_t *r, uint32_t rule, int from,
+                     int to, int flags){
+
+    const event_t *e = ics->rules[rule];
+    int64_t key = (int64_t)from * SECS_PER_DAY, len = e->end - e->start;
+    int64_t first = from;
+
+    if (flags & ICS_OVERLAP) {
+        first -= 1;
+        if (len > 0) first -= len / SECS_PER_DAY;
+        if (first < ICS_MIN_DAY) first = ICS_MIN_DAY;
+    }
+    if (key_day(e->until) < first) return 0;
+    r->rule = rule;
+    rrule_seek(&r->occur, e, (int)first, to);
+    while (rrule_next(&r->occur, &r->start)) {
+        if (r->start >= key || r->start + len > key) return 1;
+    }
+    return 0;
+}
+
+
+/* Function:   carry_rules()
+ * Parameters: ics_sweep_t *sw - a sweep
+ *             int from - first day of its next range, no earlier than
+ *                        the last
+ *             int to - last day of the range
+ * Purpose:    Brings the sweep's heap of rules up to the range: those
+ *             whose occurrence starts before from are sought again from
+ *             there, children before parents so that sifting each down
+ *             keeps the heap, and the rules that start by to are added
+ *             in order by first day. A rule with no occurrence left is
+ *             kept as a start of INT64_MAX until there are more of them
+ *             than live ones, when they are swept out.
+ */
+static void carry_rules(ics_sweep_t *sw, int from, int to){
+
+    const ics_t *ics = sw->ics;
+    const itree_t *t = &ics->spans;
+    repeat_t *r;
+    size_t n, i;
+
+    n = passed(sw->heap, sw->count, 0, (int64_t)from * SECS_PER_DAY,
+               &sw->found, &sw->cap_found, 0);
+    while (n-- > 0) {
+        r = &sw->heap[sw->found[n]];
+        if (!seek_rule(ics, r, r->rule, from, ICS_MAX_DAY, sw->flags)) {
+            r->start = INT64_MAX;
+            sw->dead++;
+        }
+        sift(sw->heap, sw->count, sw->found[n]);
+    }
+    if (sw->dead > 64 && sw->dead > sw->count / 2) {
+        for (i = n = 0; i < sw->count; i++) {
+            if (sw->heap[i].start != INT64_MAX) sw->heap[n++] = sw->heap[i];
+        }
+        sw->count = n;
+        sw->dead = 0;
+        for (i = n / 2; i-- > 0;) sift(sw->heap, n, i);
+    }
+
+    while (sw->added < t->count && t->starts[sw->added] <= to) {
+        if (sw->count == sw->cap) {
+            sw->cap = sw->cap ? sw->cap * 2 : 64;
+            sw->heap = realloc(sw->heap, sw->cap * sizeof(repeat_t));
+            if (sw->heap == NULL) {
+                fprintf(stderr, "realloc of %zu rules failed\n", sw->cap);
+                exit(1);
+            }
+        }
+        if (seek_rule(ics, &sw->heap[sw->count], ics->order[sw->added],
+                      from, ICS_MAX_DAY, sw->flags)) {
+            rise(sw->heap, sw->count++);
+        }
+        sw->added++;
+    }
+}
+
+
+/* Function:   draw_rules()
+ * Parameters: ics_sweep_t *sw - a sweep brought up to a range
+ *             int to - last day of the range
+ *             ics_iter_t *it - the range's iterator
+ * Purpose:    Copies to the iterator's heap the rules of the sweep with
+ *             an occurrence by to, cut off after it.
+ */
+static void draw_rules(ics_sweep_t *sw, int to, ics_iter_t *it){
+
+    size_t n, i;
+
+    n = passed(sw->heap, sw->count, 0, (int64_t)(to + 1) * SECS_PER_DAY,
+               &sw->found, &sw->cap_found, 0);
+    if (n > 0) {
+        it->repeats = emalloc(n * sizeof(repeat_t));
+    }
+    for (i = 0; i < n; i++) {
+        it->repeats[i] = sw->heap[sw->found[i]];
+        if (it->repeats[i].occur.last > to) it->repeats[i].occur.last = to;
+    }
+    it->nrepeats = n;
+    for (i = n / 2; i-- > 0;) sift(it->repeats, n, i);
+}
+
+
+/* Function:   passed()
+ * Parameters: const repeat_t *heap - a binary min-heap of rules
+ *             size_t count - number of rules in it
+ *             size_t i - the root of the subtree to look in
+ *             int64_t key - a start key
+ *             size_t **found - grown with realloc() to hold the indexes
+ *             size_t *cap - its size
+ *             size_t n - how many it holds already
+ * Purpose:    Adds to found the index of every rule under i whose
+ *             occurrence starts before key, each ahead of its children,
+ *             without looking under any that does not.
+ * Returns:    size_t - how many found holds now
+ */
+static size_t passed(const repeat_t *heap, size_t count, size_t i,
+                     int64_t key, size_t **found, size_t *cap, size_t n){
+
+    if (i >= count || heap[i].start >= key) return n;
+    if (n == *cap) {
+        *cap = *cap ? *cap * 2 : 64;
+        *found = realloc(*found, *cap * sizeof(size_t));
+        if (*found == NULL) {
+            fprintf(stderr, "realloc of %zu rules failed\n", *cap);
+            exit(1);
+        }
+    }
+    (*found)[n++] = i;
+    n = passed(heap, count, 2 * i + 1, key, found, cap, n);
+    return passed(heap, count, 2 * i + 2, key, found, cap, n);
+}
+
+
+/* Function:   reopen()
+ * Parameters: ics_t *ics - a watched calendar
+ * Purpose:    Opens the calendar's files afresh in place of it, to get
+ *             back the memory of the events dropped by ics_reload().
+ * Returns:    int - 0, or -1 if they could not be opened
+ */
+static int reopen(ics_t *ics){
+
+    ics_t *fresh = ics_open((const char * const *)ics->paths, ics->npaths,
+                            ics->flags);
+
+    if (fresh == NULL) return -1;
+    release(ics);
+    *ics = *fresh;
+    free(fresh);
+    return 0;
+}
+
+
+/* Function:   reload_file()
+ * Parameters: ics_t *ics - a watched calendar
+ *             int file - index of the file that changed
+ *             const struct stat *sb - what the file is now
+ *             node_t **added - list the events of new VEVENTs are put
+ *                              on the front of
+ * Purpose:    Hashes the blocks of the file and matches each with an
+ *             unmatched old block of the same hash through a table of
+ *             the old ones. A block with no match is parsed as a new
+ *             block. Every block is then ranked by its new
+ *             position, and old blocks left unmatched are marked dead.
+ *             A kept block found before one that preceded it counts as
+ *             moved, as the events may need putting back in order.
+ * Returns:    int - number of blocks added, removed or moved, or -1 if
+ *             the file could not be read
+ */
+static int reload_file(ics_t *ics, int file, const struct stat *sb,
+                       node_t **added){
+
+    watch_t *w = &ics->watch[file];
+    reader_t in, block;
+    node_t *list, *n;
+    uint32_t *slots, *order = NULL;
+    uint32_t nslots = 16, norder = 0, cap = 0, matched = 0, moved = 0;
+    uint32_t id, i, s;
+    uint64_t h, rank = 0;
+
+    if (reader_open(&in, ics->paths[file]) != 0) return -1;
+    while (nslots < 2 * w->nblocks) nslots *= 2;
+    slots = emalloc(nslots * sizeof(uint32_t));
+    memset(slots, 0, nslots * sizeof(uint32_t));
+    for (i = 0; i < w->nblocks; i++) {
+        id = w->blocks[i];
+        ics->blocks[id].live = 0;
+        for (s = ics->blocks[id].hash & (nslots - 1); slots[s] != 0;
+             s = (s + 1) & (nslots - 1));
+        slots[s] = id + 1;
+    }
+
+    while (reader_vevent(&in, &block)) {
+        h = hash_block(&block);
+        for (s = h & (nslots - 1); slots[s] != 0; s = (s + 1) & (nslots - 1)) {
+            id = slots[s] - 1;
+            if (ics->blocks[id].hash == h && !ics->blocks[id].live) break;
+        }
+        if (slots[s] != 0) {
+            if (matched++ > 0 && ics->blocks[id].rank < rank) moved++;
+            rank = ics->blocks[id].rank;
+        } else {
+            id = new_block(ics, h);
+            list = extract(&block, &ics->arena, &ics->strings);
+            for (n = list; n != NULL; n = n->next) n->val->block = id;
+            for (n = list; n != NULL && n->next != NULL; n = n->next);
+            if (n != NULL) {
+                n->next = *added;
+                *added = list;
+            }
+        }
+        ics->blocks[id].live = 1;
+        ics->blocks[id].rank = (uint64_t)file << 32 | norder;
+        if (norder == cap) {
+            cap = cap ? cap * 2 : 64;
+            order = realloc(order, cap * sizeof(uint32_t));
+            if (order == NULL) {
+                fprintf(stderr, "realloc of %u blocks failed\n", cap);
+                exit(1);
+            }
+        }
+        order[norder++] = id;
+    }
+    reader_close(&in);
+    free(slots);
+
+    i = (norder - matched) + (w->nblocks - matched) + moved;
+    free(w->blocks);
+    w->blocks = order;
+    w->nblocks = norder;
+    watch_file(w, sb);
+    return (int)i;
+}
+
+
+/* qsort_r() order of events: by start key, then by the rank of their
+ * blocks, which is the order a fresh ics_open() would give them */
+static int by_rank(const void *a, const void *b, void *arg){
+    const event_t *x = (*(node_t * const *)a)->val;
+    const event_t *y = (*(node_t * const *)b)->val;
+    const block_t *blocks = (const block_t *)arg;
+
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return (blocks[x->block].rank > blocks[y->block].rank) -
+           (blocks[x->block].rank < blocks[y->block].rank);
+}
+
+
+/* qsort_r() order of rules: by the rank of their blocks */
+static int by_block(const void *a, const void *b, void *arg){
+    const event_t *x = *(event_t * const *)a;
+    const event_t *y = *(event_t * const *)b;
+    const block_t *blocks = (const block_t *)arg;
+
+    return (blocks[x->block].rank > blocks[y->block].rank) -
+           (blocks[x->block].rank < blocks[y->block].rank);
+}
+
+
+/* Whether an event of block x starting at a comes after one of block y
+ * starting at b */
+static int after(const ics_t *ics, int64_t a, uint32_t x, int64_t b,
+                 uint32_t y){
+    return a > b || (a == b && ics->blocks[x].rank > ics->blocks[y].rank);
+}
+
+
+/* Function:   patch()
+ * Parameters: ics_t *ics - a watched calendar, blocks marked by
+ *                          reload_file()
+ *             node_t *added - the events of its new blocks
+ * Purpose:    Drops the events of dead blocks from the sorted arrays, in
+ *             one pass that also checks the rest are still in order (a
+ *             block moved within its file changes rank), sorts the new
+ *             events on their own and merges the two. The events kept
+ *             are compared by the keys and block ids held alongside the
+ *             itree, so they are not touched. The itree and day index
+ *             are then rebuilt over the result.
+ */
+static void patch(ics_t *ics, node_t *added){
+
+    itree_t *t = &ics->tree;
+    node_t **fresh, **nodes, *n;
+    int64_t *starts, *ends;
+    uint32_t *summaries, *locations, *ids;
+    size_t nfresh = 0, nkeep = 0, i, j, k;
+    int sorted = 1;
+
+    for (n = added; n != NULL; n = n->next) nfresh++;
+    fresh = emalloc((nfresh + 1) * sizeof(node_t *));
+    for (n = added, i = 0; n != NULL; n = n->next) fresh[i++] = n;
+    qsort_r(fresh, nfresh, sizeof(node_t *), by_rank, ics->blocks);
+
+    for (i = 0; i < t->count; i++) {
+        if (!ics->blocks[ics->ids[i]].live) {
+            ics->garbage++;
+            continue;
+        }
+        if (nkeep > 0 && after(ics, t->starts[nkeep - 1], ics->ids[nkeep - 1],
+                               t->starts[i], ics->ids[i])) {
+            sorted = 0;
+        }
+        t->nodes[nkeep] = t->nodes[i];
+        t->starts[nkeep] = t->starts[i];
+        t->ends[nkeep] = t->ends[i];
+        t->summaries[nkeep] = t->summaries[i];
+        t->locations[nkeep] = t->locations[i];
+        ics->ids[nkeep++] = ics->ids[i];
+    }
+    if (!sorted) {
+        qsort_r(t->nodes, nkeep, sizeof(node_t *), by_rank, ics->blocks);
+        for (i = 0; i < nkeep; i++) {
+            t->starts[i] = t->nodes[i]->val->start;
+            t->ends[i] = t->nodes[i]->val->end;
+            t->summaries[i] = t->nodes[i]->val->summary;
+            t->locations[i] = t->nodes[i]->val->location;
+            ics->ids[i] = t->nodes[i]->val->block;
+        }
+    }
+
+    k = nkeep + nfresh;
+    nodes = emalloc((k + 1) * sizeof(node_t *));
+    starts = emalloc((k + 1) * sizeof(int64_t));
+    ends = emalloc((k + 1) * sizeof(int64_t));
+    summaries = emalloc((k + 1) * sizeof(uint32_t));
+    locations = emalloc((k + 1) * sizeof(uint32_t));
+    ids = emalloc((k + 1) * sizeof(uint32_t));
+    for (i = j = k = 0; i < nkeep || j < nfresh; k++) {
+        if (j == nfresh || (i < nkeep &&
+            !after(ics, t->starts[i], ics->ids[i], fresh[j]->val->start,
+                   fresh[j]->val->block))) {
+            nodes[k] = t->nodes[i];
+            starts[k] = t->starts[i];
+            ends[k] = t->ends[i];
+            summaries[k] = t->summaries[i];
+            locations[k] = t->locations[i];
+            ids[k] = ics->ids[i++];
+        } else {
+            nodes[k] = fresh[j];
+            starts[k] = fresh[j]->val->start;
+            ends[k] = fresh[j]->val->end;
+            summaries[k] = fresh[j]->val->summary;
+            locations[k] = fresh[j]->val->location;
+            ids[k] = fresh[j++]->val->block;
+        }
+    }
+
+    itree_adopt(t, nodes, starts, ends, summaries, locations, k);
+    free(ics->ids);
+    ics->ids = ids;
+    free(ics->days);
+    ics->days = NULL;
+    ics->ndays = 0;
+    index_days(ics);
+    free(fresh);
+}
+
+
+/* Function:   rank_rules()
+ * Parameters: ics_t *ics - a watched calendar, blocks marked by
+ *                          reload_file()
+ *             node_t *added - the events of its new blocks
+ * Purpose:    Drops the rules of dead blocks, adds those among the new
+ *             events and puts them back in order by the rank of their
+ *             blocks, as a fresh ics_open() would have them.
+ */
+static void rank_rules(ics_t *ics, node_t *added){
+
+    event_t **rules;
+    node_t *n;
+    uint32_t k = 0, i;
+
+    for (n = added; n != NULL; n = n->next) k += n->val->until != NO_RRULE;
+    rules = emalloc((ics->nrules + k + 1) * sizeof(event_t *));
+    k = 0;
+    for (i = 0; i < ics->nrules; i++) {
+        if (ics->blocks[ics->rules[i]->block].live) rules[k++] = ics->rules[i];
+    }
+    for (n = added; n != NULL; n = n->next) {
+        if (n->val->until != NO_RRULE) rules[k++] = n->val;
+    }
+    qsort_r(rules, k, sizeof(event_t *), by_block, ics->blocks);
+    free(ics->rules);
+    ics->rules = rules;
+    ics->nrules = k;
+    index_rules(ics);
+}
+
+
+/* Function:   extract_blocks()
+ * Parameters: run_t *run - a run of a watched calendar
+ * Purpose:    Parses a run one VEVENT block at a time, noting the hash
+ *             of each block and tagging its events with the block's
+ *             index in the run.
+ * Returns:    node_t *head - head of an unsorted list of the run's
+ *             events, in the order of the file
+ */
+static node_t *extract_blocks(run_t *run){
+
+    reader_t block;
+    node_t *head = NULL, *tail = NULL, *list, *n;
+
+    while (reader_vevent(&run->in, &block)) {
+        if (run->nblocks == run->cap) {
+            run->cap = run->cap ? run->cap * 2 : 256;
+            run->hashes = realloc(run->hashes, run->cap * sizeof(uint64_t));
+            if (run->hashes == NULL) {
+                fprintf(stderr, "realloc of %u hashes failed\n", run->cap);
+                exit(1);
+            }
+        }
+        run->hashes[run->nblocks] = hash_block(&block);
+        list = extract(&block, &run->arena, &run->strings);
+        for (n = list; n != NULL; n = n->next) {
+            n->val->block = run->nblocks;
+            if (n->next == NULL) break;
+        }
+        run->nblocks++;
+        if (list == NULL) continue;
+        if (tail == NULL) {
+            head = list;
+        } else {
+            tail->next = list;
+            list->prev = tail;
+        }
+        tail = n;
+    }
+    return head;
+}
+
+
+/* Function:   adopt_blocks()
+ * Parameters: ics_t *ics - a watched calendar, its runs parsed
+ * Purpose:    Gives the blocks of every run ids in the calendar's table,
+ *             in file order, and renumbers the events of the runs to
+ *             match. Called from the main thread once the workers are
+ *             done.
+ */
+static void adopt_blocks(ics_t *ics){
+
+    run_t *run;
+    watch_t *w;
+    node_t *n;
+    uint32_t base, i;
+    int r;
+
+    for (r = 0; r < ics->nruns; r++) {
+        run = &ics->runs[r];
+        w = &ics->watch[run->file];
+        base = ics->nblocks;
+        w->blocks = realloc(w->blocks,
+                            (w->nblocks + run->nblocks + 1) * sizeof(uint32_t));
+        if (w->blocks == NULL) {
+            fprintf(stderr, "realloc of %u blocks failed\n", w->nblocks);
+            exit(1);
+        }
+        for (i = 0; i < run->nblocks; i++) {
+            w->blocks[w->nblocks] = new_block(ics, run->hashes[i]);
+            ics->blocks[base + i].rank =
+                (uint64_t)run->file << 32 | w->nblocks;
+            w->nblocks++;
+        }
+        for (n = run->head; n != NULL; n = n->next) n->val->block += base;
+        free(run->hashes);
+        run->hashes = NULL;
+    }
+}
+
+
+/* Function:   new_block()
+ * Parameters: ics_t *ics - a watched calendar
+ *             uint64_t hash - hash of the block's text
+ * Purpose:    Adds a live block to the table, growing it when full.
+ * Returns:    uint32_t id - the block's id
+ */
+static uint32_t new_block(ics_t *ics, uint64_t hash){
+    if (ics->nblocks == ics->cap) {
+        ics->cap = ics->cap ? ics->cap * 2 : 1024;
+        ics->blocks = realloc(ics->blocks, ics->cap * sizeof(block_t));
+        if (ics->blocks == NULL) {
+            fprintf(stderr, "realloc of %u blocks failed\n", ics->cap);
+            exit(1);
+        }
+    }
+    ics->blocks[ics->nblocks].hash = hash;
+    ics->blocks[ics->nblocks].rank = 0;
+    ics->blocks[ics->nblocks].live = 1;
+    return ics->nblocks++;
+}
+
+
+/* Function:   watch_file()
+ * Parameters: watch_t *w - a watched calendar
+ *             const struct stat *sb - its file as it is being read
+ * Purpose:    Notes which file was read, to tell when it changes.
+ */
+static void watch_file(watch_t *w, const struct stat *sb){
+    w->dev = sb->st_dev;
+    w->ino = sb->st_ino;
+    w->size = sb->st_size;
+    w->mtime = sb->st_mtim;
+}
+
+
+/* FNV-1a over the text of a block */
+static uint64_t hash_block(const reader_t *block){
+    uint64_t h = 14695981039346656037ULL;
+    size_t i;
+
+    for (i = 0; i < block->size; i++) {
+        h ^= (unsigned char)block->base[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+
+/* Function:   is_ics()
+ * Parameters: const struct dirent *entry - entry of a directory
+ * Purpose:    scandir() filter for names ending in ".ics"
+ * Returns:    int - 0 or 1, false or true respectively
+ */
+static int is_ics(const struct dirent *entry){
+    size_t len = strlen(entry->d_name);
+    return len > 4 && strcmp(entry->d_name + len - 4, ".ics") == 0;
+}
+
+
+/* Function:   push_path()
+ * Parameters: char ***paths - growing array of paths to calendars
+ *             int *count - number of paths in the array
+ *             int *cap - room in the array
+ *             char *path - path to append, now owned by the array
+ * Purpose:    Appends a path, doubling the array when it is full.
+ */
+static void push_path(char ***paths, int *count, int *cap, char *path){
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 16;
+        *paths = realloc(*paths, *cap * sizeof(char *));
+        if (*paths == NULL) {
+            fprintf(stderr, "realloc of %d paths failed\n", *cap);
+            exit(1);
+        }
+    }
+    (*paths)[(*count)++] = path;
+}
+
+
+/* Function:   add_path()
+ * Parameters: char ***paths - growing array of paths to calendars
+ *             int *count - number of paths in the array
+ *             int *cap - room in the array
+ *             const char *path - a calendar, or a directory of calendars
+ * Purpose:    Appends a copy of the path, or if it is a directory the
+ *             path of every .ics file in it, in order by name.
+ * Returns:    int - 0, or -1 if a directory could not be read
+ */
+static int add_path(char ***paths, int *count, int *cap, const char *path){
+
+    struct stat sb;
+    struct dirent **names;
+    char *copy;
+    int n, i;
+
+    if (stat(path, &sb) == 0 && S_ISDIR(sb.st_mode)) {
+        n = scandir(path, &names, is_ics, alphasort);
+        if (n < 0) {
+            fprintf(stderr, "unable to read directory %s\n", path);
+            return -1;
+        }
+        for (i = 0; i < n; i++) {
+            copy = emalloc(strlen(path) + strlen(names[i]->d_name) + 2);
+            sprintf(copy, "%s/%s", path, names[i]->d_name);
+            free(names[i]);
+            push_path(paths, count, cap, copy);
+        }
+        free(names);
+        return 0;
+    }
+
+    copy = emalloc(strlen(path) + 1);
+    strcpy(copy, path);
+    push_path(paths, count, cap, copy);
+    return 0;
+}
+
+
+/* Function:   open_runs()
+ * Parameters: char **paths - calendars to read
+ *             int count - number of paths
+ *             reader_t *files - one reader per path, opened here
+ *             cache_t *caches - one sidecar index per path, or NULL to
+ *                               neither read nor write them
+ *             int *nruns - set to the number of runs returned
+ * Purpose:    A calendar with a valid index is read from it as a single
+ *             run. Every other file is mapped and cut into runs of about
+ *             CHUNK_LEN bytes that start on a BEGIN:VEVENT line, so that
+ *             a single large file is parsed by as many threads as a
+ *             directory of small ones. Runs are in file order, and in
+ *             order within a file, which merge_runs() keeps for events
+ *             with equal keys.
+ * Returns:    run_t *runs - the runs, cleared but for their input, or
+ *             NULL if a calendar could not be opened
+ */
+static run_t *open_runs(char **paths, int count, reader_t *files,
+                        cache_t *caches, int *nruns){
+
+    run_t *runs;
+    reader_t *parts;
+    size_t max = 0;
+    int i, j, k, n = 0;
+
+    memset(files, 0, count * sizeof(reader_t));
+    if (caches != NULL) memset(caches, 0, count * sizeof(cache_t));
+    for (i = 0; i < count; i++) {
+        if (caches != NULL && cache_open(&caches[i], paths[i]) == 0) {
+            max++;
+            continue;
+        }
+        if (reader_open(&files[i], paths[i]) != 0) {
+            fprintf(stderr, "unable to open %s\n", paths[i]);
+            return NULL;
+        }
+        max += files[i].size / CHUNK_LEN + 1;
+    }
+
+    runs = emalloc((max + 1) * sizeof(run_t));
+    parts = emalloc((max + 1) * sizeof(reader_t));
+    memset(runs, 0, (max + 1) * sizeof(run_t));
+    for (i = 0; i < count; i++) {
+        if (caches != NULL && caches[i].base != NULL) {
+            runs[n].cache = &caches[i];
+            runs[n++].file = i;
+            continue;
+        }
+        k = reader_split(&files[i], parts, CHUNK_LEN,
+                         files[i].size / CHUNK_LEN + 1);
+        for (j = 0; j < k; j++) {
+            runs[n].in = parts[j];
+            runs[n].file = i;
+            runs[n++].keep = caches != NULL;
+        }
+    }
+    free(parts);
+    *nruns = n;
+    return runs;
+}
+
+
+/* Function:   save_cache()
+ * Parameters: const char *path - the calendar
+ *             run_t *runs - all runs, parsed but not yet merged
+ *             int count - number of runs
+ *             int file - index of the calendar among the paths
+ * Purpose:    Gathers the events kept by the calendar's runs, with their
+ *             strings renumbered into one table for the file, and writes
+ *             them to the calendar's sidecar index with cache_write().
+ *             Failing to write the index is not an error.
+ */
+static void save_cache(const char *path, run_t *runs, int count, int file){
+
+    strtab_t strings;
+    event_t *events;
+    uint32_t n = 0, i;
+    const char *s;
+    int r;
+
+    for (r = 0; r < count; r++) {
+        if (runs[r].file == file) n += runs[r].nevents;
+    }
+    memset(&strings, 0, sizeof(strtab_t));
+    events = emalloc((n + 1) * sizeof(event_t));
+    n = 0;
+    for (r = 0; r < count; r++) {
+        if (runs[r].file != file) continue;
+        for (i = 0; i < runs[r].nevents; i++) {
+            events[n] = *runs[r].events[i];
+            s = strtab_get(&runs[r].strings, events[n].summary);
+            events[n].summary = strtab_intern(&strings, s, strlen(s));
+            s = strtab_get(&runs[r].strings, events[n].location);
+            events[n].location = strtab_intern(&strings, s, strlen(s));
+            n++;
+        }
+    }
+    cache_write(path, events, n, &strings);
+    strtab_free(&strings);
+    free(events);
+}
+
+
+/* Function:   load_cache()
+ * Parameters: run_t *run - a run read from a sidecar index
+ * Purpose:    Interns the saved strings in order, so that the ids in the
+ *             saved events stay valid in the run's table, and links the
+ *             saved events, in place in the mapping, into a list. A
+ *             damaged index may hold a string twice; then the ids are
+ *             mapped to the ones the table gave.
+ * Returns:    node_t *head - head of a list of the calendar's events, in
+ *             the order of the file
+ */
+static node_t *load_cache(run_t *run){
+
+    cache_t *c = run->cache;
+    node_t *node, *head = NULL, *tail = NULL;
+    uint32_t *ids = NULL;
+    const char *s;
+    uint32_t i, j, id;
+
+    for (i = 0; i < c->nstrings; i++) {
+        s = cache_string(c, i);
+        id = strtab_intern(&run->strings, s, strlen(s));
+        if (id != i && ids == NULL) {
+            ids = emalloc(c->nstrings * sizeof(uint32_t));
+            for (j = 0; j < i; j++) ids[j] = j;
+        }
+        if (ids != NULL) ids[i] = id;
+    }
+    for (i = 0; i < c->nevents; i++) {
+        if (ids != NULL) {
+            c->events[i].summary = ids[c->events[i].summary];
+            c->events[i].location = ids[c->events[i].location];
+        }
+        node = arena_node(&run->arena, &c->events[i]);
+        if (tail == NULL) head = add_front(head, node);
+        else insert_after(tail, node);
+        tail = node;
+    }
+    free(ids);
+    return head;
+}
+
+
+/* Function:   parse_files()
+ * Parameters: run_t *runs - the runs to parse, readers filled in
+ *             int count - number of runs
+ *             int flags - ICS_WATCH to read them by blocks, ICS_STATS
+ *                         to time them
+ * Purpose:    Parses the runs on a pool of threads, one per online core
+ *             but no more than there are runs. Each worker takes the
+ *             next unparsed run until none are left, so a few large
+ *             calendars do not hold up the rest. The main thread waits
+ *             for all of them.
+ */
+static void parse_files(run_t *runs, int count, int flags){
+
+    pthread_t threads[MAX_THREADS];
+    pool_t pool = {runs, count, 0, flags, PTHREAD_MUTEX_INITIALIZER};
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int n = cores < 1 ? 1 : cores > MAX_THREADS ? MAX_THREADS : (int)cores;
+    int i;
+
+    if (n > count) n = count;
+    if (n <= 1) {
+        parse_worker(&pool);
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (pthread_create(&threads[i], NULL, parse_worker, &pool) != 0) {
+            break;
+        }
+    }
+    if (i == 0) parse_worker(&pool);
+    while (i-- > 0) pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&pool.lock);
+}
+
+
+/* Function:   parse_worker()
+ * Parameters: void *arg - address of the pool_t
+ * Purpose:    Thread body for parse_files(): parses runs from the pool
+ *             with parse_run() until every run has been taken.
+ * Returns:    void * - NULL
+ */
+static void *parse_worker(void *arg){
+
+    pool_t *pool = (pool_t *)arg;
+    int i;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (i >= pool->count) break;
+        parse_run(&pool->runs[i], pool->flags);
+    }
+    return NULL;
+}
+
+
+/* Function:   parse_run()
+ * Parameters: run_t *run - the run to parse
+ *             int flags - ICS_WATCH to read it by blocks, ICS_STATS to
+ *                         time it
+ * Purpose:    Reads one run into its own arena and string table, from the
+ *             calendar or its sidecar index, notes its repeating events
+ *             in file order and sorts it, leaving it ready for
+ *             merge_runs(). If the run is to be saved, the parsed events
+ *             are noted as well. Nothing is shared with other runs but
+ *             the read-only mappings, so this needs no locking.
+ */
+static void parse_run(run_t *run, int flags){
+
+    node_t *head, *n;
+    stat_clock_t clock;
+    uint32_t i = 0;
+
+    if (flags & ICS_STATS) stats_start(&clock);
+
+    if (run->cache != NULL) {
+        head = load_cache(run);
+    } else if (flags & ICS_WATCH) {
+        head = extract_blocks(run);
+    } else {
+        head = extract(&run->in, &run->arena, &run->strings);
+    }
+    if (flags & ICS_STATS) {
+        stats_lap(&run->stats, STAT_PARSE, &clock);
+        for (n = head; n != NULL; n = n->next) run->stats.vevents++;
+        stats_start(&clock);
+    }
+
+    if (run->keep) {
+        for (n = head; n != NULL; n = n->next) run->nevents++;
+        run->events = arena_alloc(&run->arena,
+                                  (run->nevents + 1) * sizeof(event_t *));
+        for (n = head; n != NULL; n = n->next) run->events[i++] = n->val;
+    }
+    for (n = head; n != NULL; n = n->next) {
+        run->nrules += n->val->until != NO_RRULE;
+    }
+    run->rules = arena_alloc(&run->arena,
+                             (run->nrules + 1) * sizeof(event_t *));
+    for (n = head, i = 0; n != NULL; n = n->next) {
+        if (n->val->until != NO_RRULE) run->rules[i++] = n->val;
+    }
+
+    run->head = sort_list(head);
+    if (flags & ICS_STATS) {
+        stats_lap(&run->stats, STAT_SORT, &clock);
+        if (run->cache == NULL) {
+            run->stats.bytes = run->in.size;
+            run->stats.lines = stats_lines(run->in.base, run->in.size);
+        }
+    }
+}
+
+
+/* Function:   add_runs()
+ * Parameters: stats_t *stats - statistics to add to
+ *             const run_t *runs - runs just parsed
+ *             int count - number of runs
+ *             stat_clock_t *clock - read just before they were parsed,
+ *                                   and read again here
+ * Purpose:    Adds the statistics of runs parsed by parse_files(). Their
+ *             CPU times are added up over the threads, but their wall
+ *             times overlap, so the time parse_files() took is charged
+ *             instead, shared between parsing and sorting as the threads'
+ *             own wall times were.
+ */
+static void add_runs(stats_t *stats, const run_t *runs, int count,
+                     stat_clock_t *clock){
+
+    stats_t sum;
+    stat_clock_t now;
+    double busy, took;
+    int i;
+
+    memset(&sum, 0, sizeof(stats_t));
+    for (i = 0; i < count; i++) stats_add(&sum, &runs[i].stats);
+    stats_start(&now);
+    took = now.wall - clock->wall;
+    busy = sum.wall[STAT_PARSE] + sum.wall[STAT_SORT];
+    sum.wall[STAT_PARSE] = busy > 0 ? took * sum.wall[STAT_PARSE] / busy
+                                    : took;
+    sum.wall[STAT_SORT] = took - sum.wall[STAT_PARSE];
+    stats_add(stats, &sum);
+    *clock = now;
+}
+
+
+/* Function:   adopt_strings()
+ * Parameters: run_t *run - a parsed run
+ *             strtab_t *strings - the table shared by all runs
+ * Purpose:    Interns the strings of a run into the shared table and
+ *             renumbers the summary and location of its events to match,
+ *             then frees the run's own table. Called from the main thread
+ *             once the workers are done.
+ */
+static void adopt_strings(run_t *run, strtab_t *strings){
+
+    uint32_t *ids = emalloc((run->strings.count + 1) * sizeof(uint32_t));
+    const char *s;
+    node_t *n;
+    uint32_t i;
+
+    for (i = 0; i < run->strings.count; i++) {
+        s = strtab_get(&run->strings, i);
+        ids[i] = strtab_intern(strings, s, strlen(s));
+    }
+    for (n = run->head; n != NULL; n = n->next) {
+        n->val->summary = ids[n->val->summary];
+        n->val->location = ids[n->val->location];
+    }
+    free(ids);
+    strtab_free(&run->strings);
+}
@@ -0,0 +1,75 @@
+#ifndef _LIBICS_H_
+#define _LIBICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stats.h"
+
+/*
+ * Calendars loaded once and queried from memory. Days are counted from
+ * 1970-01-01 and times are seconds from its midnight, floating as they
+ * are written in the files.
+ */
+
+#define ICS_MIN_DAY     (INT32_MIN / 2)     /* bounds of any day passed in */
+#define ICS_MAX_DAY     (INT32_MAX / 2)
+
+#define ICS_INDEX       0x1     /* ics_open(): read and write sidecar indexes */
+#define ICS_OVERLAP     0x2     /* ics_query_range(): and events under way */
+#define ICS_WATCH       0x4     /* ics_open(): allow ics_reload() */
+#define ICS_STATS       0x8     /* ics_open(): keep statistics */
+
+typedef struct ics_t ics_t;
+
+typedef struct ics_event_t {
+    int64_t      start;
+    int64_t      end;
+    const char  *summary;       /* owned by the ics_t */
+    const char  *location;
+} ics_event_t;
+
+/* Events found by a query, read in order by start with ics_next(): the
+ * nhits events listed in hits, then the rest from index first on,
+ * merged with the occurrences drawn from a heap of nrepeats rules. The
+ * fields are private. */
+typedef struct ics_iter_t {
+    const ics_t        *ics;
+    uint32_t           *hits;
+    size_t              nhits;
+    size_t              first;
+    size_t              pos;
+    size_t              count;
+    struct repeat_t    *repeats;
+    size_t              nrepeats;
+    uint64_t            generated;
+} ics_iter_t;
+
+/* Queries of many ranges in order by first day that carry one heap of
+ * rules on from each range to the next. The fields are private. */
+typedef struct ics_sweep_t {
+    const ics_t        *ics;
+    int                 flags;
+    int                 from;
+    size_t              added;
+    struct repeat_t    *heap;
+    size_t              count;
+    size_t              cap;
+    size_t              dead;
+    size_t             *found;
+    size_t              cap_found;
+} ics_sweep_t;
+
+ics_t   *ics_open(const char * const *paths, int count, int flags);
+void     ics_close(ics_t *);
+int      ics_reload(ics_t *);
+size_t   ics_count(const ics_t *, int *first, int *last);
+void     ics_stats(const ics_t *, stats_t *);
+void     ics_query_range(const ics_t *, int from, int to, int flags,
+                         ics_iter_t *);
+void     ics_events_for_day(const ics_t *, int day, ics_iter_t *);
+void     ics_sweep_init(ics_sweep_t *, const ics_t *, int flags);
+void     ics_sweep_range(ics_sweep_t *, int from, int to, ics_iter_t *);
+void     ics_sweep_free(ics_sweep_t *);
+int      ics_next(ics_iter_t *, ics_event_t *);
+void     ics_iter_free(ics_iter_t *);
+#endif
@@ -27,8 +27,29 @@ node_t *new_node(event_t *val) {
 }
 
 
+/*
+ * As new_node(), but carved out of an arena instead of malloc'd, so
+ * that it is released with the rest of the arena.
+ */
+node_t *arena_node(arena_t *arena, event_t *val) {
+    assert( val != NULL);
+
+    node_t *temp = (node_t *)arena_alloc(arena, sizeof(node_t));
+
+    temp->val = val;
+    temp->next = NULL;
+    temp->prev = NULL;
+
+    return temp;
+}
+
+
 node_t *add_front(node_t *list, node_t *new) {
     new->next = list;
+    new->prev = NULL;
+    if (list != NULL) {
+        list->prev = new;
+    }
     return new;
 }
 
@@ -60,25 +81,9 @@ node_t *insert(node_t *list, node_t *new){
 
     cur = list;
 
-    if(atoi(new->val->dtstart) == atoi(cur->val->dtstart) &&
-       atoi(cur->val->tmstart) < atoi(new->val->tmstart)){
-        while(cur != NULL &&
-              atoi(new->val->dtstart) == atoi(cur->val->dtstart) &&
-              atoi(cur->val->tmstart) < atoi(new->val->tmstart)){
-            pre = cur;
-            cur = cur->next;
-        }
-    }else{
-        while(cur != NULL && atoi(new->val->dtstart) > atoi(cur->val->dtstart)){
-            pre = cur;
-            cur = cur->next;
-        }
-        while(cur != NULL &&
-              atoi(new->val->dtstart) == atoi(cur->val->dtstart) &&
-              atoi(cur->val->tmstart) < atoi(new->val->tmstart)){
-            pre = cur;
-            cur = cur->next;
-        }
+    while(cur != NULL && cur->val->start < new->val->start){
+        pre = cur;
+        cur = cur->next;
     }
     
     if(pre == NULL){
@@ -101,6 +106,148 @@ node_t *insert(node_t *list, node_t *new){
 }
 
 
+/*
+ * Splices "new" in directly after "pos" in O(1), whatever their keys.
+ * Used to build a list quickly before a single sort_list().
+ */
+node_t *insert_after(node_t *pos, node_t *new) {
+    new->prev = pos;
+    new->next = pos->next;
+    if (pos->next != NULL) {
+        pos->next->prev = new;
+    }
+    pos->next = new;
+    return new;
+}
+
+
+static node_t *merge(node_t *a, node_t *b) {
+    node_t head;
+    node_t *tail = &head;
+
+    while (a != NULL && b != NULL) {
+        if (b->val->start < a->val->start) {
+            tail->next = b;
+            b = b->next;
+        } else {
+            tail->next = a;
+            a = a->next;
+        }
+        tail = tail->next;
+    }
+    tail->next = (a != NULL) ? a : b;
+    return head.next;
+}
+
+
+/*
+ * Orders a list by start key with a stable, bottom-up merge sort:
+ * O(n log n) in total, against O(n) per call for insert(). bins[i]
+ * holds a sorted run of 2^i nodes, like the digits of a binary counter.
+ * Returns the new head; prev links are rebuilt at the end.
+ */
+node_t *sort_list(node_t *list) {
+    node_t *bins[64] = {NULL};
+    node_t *cur, *prev;
+    int i, max = 0;
+
+    while (list != NULL) {
+        cur = list;
+        list = list->next;
+        cur->next = NULL;
+        for (i = 0; i < 63 && bins[i] != NULL; i++) {
+            cur = merge(bins[i], cur);
+            bins[i] = NULL;
+        }
+        bins[i] = (bins[i] != NULL) ? merge(bins[i], cur) : cur;
+        if (i > max) max = i;
+    }
+    for (i = 0; i <= max; i++) {
+        list = merge(bins[i], list);
+    }
+
+    for (cur = list, prev = NULL; cur != NULL; prev = cur, cur = cur->next) {
+        cur->prev = prev;
+    }
+    return list;
+}
+
+
+/*
+ * Moves the root of a binary min-heap of runs down to its place. Runs
+ * are ordered by the start key of their first node, ties going to the
+ * run with the lower index so that the merge is stable.
+ */
+static void sift_down(node_t **heap, int *idx, int n, int i) {
+    node_t *node = heap[i];
+    int at = idx[i];
+    int child;
+
+    while ((child = 2 * i + 1) < n) {
+        if (child + 1 < n &&
+            (heap[child + 1]->val->start < heap[child]->val->start ||
+             (heap[child + 1]->val->start == heap[child]->val->start &&
+              idx[child + 1] < idx[child]))) {
+            child++;
+        }
+        if (node->val->start < heap[child]->val->start ||
+            (node->val->start == heap[child]->val->start && at < idx[child])) {
+            break;
+        }
+        heap[i] = heap[child];
+        idx[i] = idx[child];
+        i = child;
+    }
+    heap[i] = node;
+    idx[i] = at;
+}
+
+
+/*
+ * Merges k lists, each already in order by start key, into one with a
+ * binary heap holding the head of every run: O(n log k). Events with
+ * equal keys keep the order of their runs. Returns the new head, with
+ * prev links set.
+ */
+node_t *merge_runs(node_t **runs, int k) {
+    node_t **heap = emalloc(k * sizeof(node_t *));
+    int *idx = emalloc(k * sizeof(int));
+    node_t head = {NULL, NULL, NULL};
+    node_t *tail = &head;
+    int i, n = 0;
+
+    for (i = 0; i < k; i++) {
+        if (runs[i] != NULL) {
+            heap[n] = runs[i];
+            idx[n++] = i;
+        }
+    }
+    for (i = n / 2 - 1; i >= 0; i--) {
+        sift_down(heap, idx, n, i);
+    }
+
+    while (n > 0) {
+        tail->next = heap[0];
+        heap[0]->prev = tail == &head ? NULL : tail;
+        tail = heap[0];
+        if (heap[0]->next != NULL) {
+            heap[0] = heap[0]->next;
+        } else {
+            heap[0] = heap[--n];
+            idx[0] = idx[n];
+        }
+        if (n > 0) {
+            sift_down(heap, idx, n, 0);
+        }
+    }
+    tail->next = NULL;
+
+    free(heap);
+    free(idx);
+    return head.next;
+}
+
+
 node_t *peek_front(node_t *list) {
     return list;
 }
@@ -1,6 +1,8 @@
 #ifndef _LINKEDLIST_H_
 #define _LINKEDLIST_H_
 
+#include <stddef.h>
+#include "arena.h"
 #include "ics.h"
 
 typedef struct node_t {
@@ -10,9 +12,13 @@ typedef struct node_t {
 } node_t;
 
 node_t *new_node(event_t *val);
+node_t *arena_node(arena_t *, event_t *val);
 node_t *add_front(node_t *, node_t *);
 node_t *add_end(node_t *, node_t *);
 node_t *insert(node_t *, node_t *);
+node_t *insert_after(node_t *, node_t *);
+node_t *sort_list(node_t *);
+node_t *merge_runs(node_t **, int);
 node_t *peek_front(node_t *);
 node_t *remove_front(node_t *);
 void    r_apply(node_t *, void(*fn)(node_t *, void *), void *arg);
@@ -0,0 +1,174 @@
+/*
+ * outbuf.c
+ *
+ * Buffered output. Text is gathered in one large buffer that is reused
+ * for the whole run and handed to the kernel with write(), or writev()
+ * when a piece too big for the space left would otherwise cost an extra
+ * copy. The text never passes through stdio.
+ *
+ * A buffer given a held_t with out_hold() writes to a non-blocking
+ * descriptor: what the descriptor will not take yet is kept there, and
+ * so is everything written after it, until out_drain() hands it over
+ * once the descriptor can take more.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "outbuf.h"
+
+
+/*
+ * Appends n bytes to the held text, first moving what is still to be
+ * sent to the front if that makes room.
+ */
+static void hold(held_t *h, const char *s, size_t n) {
+    if (h->sent > 0 && h->cap - h->len < n) {
+        memmove(h->buf, h->buf + h->sent, h->len - h->sent);
+        h->len -= h->sent;
+        h->sent = 0;
+    }
+    if (h->cap - h->len < n) {
+        h->cap = h->cap * 2 > h->len + n ? h->cap * 2 : h->len + n;
+        h->buf = realloc(h->buf, h->cap);
+        if (h->buf == NULL) {
+            fprintf(stderr, "realloc of %zu held bytes failed\n", h->cap);
+            exit(1);
+        }
+    }
+    memcpy(h->buf + h->len, s, n);
+    h->len += n;
+}
+
+
+/*
+ * Writes every byte of the given pieces, retrying short and
+ * interrupted writes. On an error it is noted in the buffer, and
+ * nothing more is written to it. With a held_t, the pieces are held
+ * from the first that would block, or all of them if some text is held
+ * already.
+ */
+static void write_all(outbuf_t *out, struct iovec *iov, int n) {
+    ssize_t done;
+
+    while (n > 0 && out->error == 0) {
+        if (out->held != NULL && out->held->len > out->held->sent) {
+            for (; n > 0; iov++, n--) {
+                hold(out->held, iov->iov_base, iov->iov_len);
+            }
+            break;
+        }
+        done = writev(out->fd, iov, n);
+        if (done < 0) {
+            if (out->held != NULL &&
+                (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                for (; n > 0; iov++, n--) {
+                    hold(out->held, iov->iov_base, iov->iov_len);
+                }
+            } else if (errno != EINTR) {
+                out->error = errno;
+            }
+            continue;
+        }
+        while (n > 0 && (size_t)done >= iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+}
+
+
+void out_init(outbuf_t *out, int fd) {
+    out->fd = fd;
+    out->len = 0;
+    out->error = 0;
+    out->held = NULL;
+}
+
+
+void out_hold(outbuf_t *out, held_t *held) {
+    out->held = held;
+}
+
+
+void out_write(outbuf_t *out, const char *s, size_t n) {
+    struct iovec iov[2];
+
+    if (n <= OUTBUF_LEN - out->len) {
+        memcpy(out->buf + out->len, s, n);
+        out->len += n;
+        return;
+    }
+    iov[0].iov_base = out->buf;
+    iov[0].iov_len  = out->len;
+    iov[1].iov_base = (void *)s;
+    iov[1].iov_len  = n;
+    write_all(out, iov, 2);
+    out->len = 0;
+}
+
+
+void out_str(outbuf_t *out, const char *s) {
+    out_write(out, s, strlen(s));
+}
+
+
+void out_char(outbuf_t *out, char c) {
+    if (out->len == OUTBUF_LEN) {
+        out_flush(out);
+    }
+    out->buf[out->len++] = c;
+}
+
+
+int out_flush(outbuf_t *out) {
+    struct iovec iov;
+
+    if (out->len > 0) {
+        iov.iov_base = out->buf;
+        iov.iov_len  = out->len;
+        write_all(out, &iov, 1);
+        out->len = 0;
+    }
+    if (out->error != 0) {
+        errno = out->error;
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * Writes as much of the held text as fd will take. Returns 0, or -1 if
+ * the write failed.
+ */
+int out_drain(int fd, held_t *h) {
+    ssize_t done;
+
+    while (h->sent < h->len) {
+        done = write(fd, h->buf + h->sent, h->len - h->sent);
+        if (done < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        h->sent += done;
+    }
+    h->sent = h->len = 0;
+    return 0;
+}
+
+
+void held_free(held_t *h) {
+    free(h->buf);
+    memset(h, 0, sizeof(held_t));
+}
@@ -0,0 +1,33 @@
+#ifndef _OUTBUF_H_
+#define _OUTBUF_H_
+
+#include <stddef.h>
+
+#define OUTBUF_LEN   (64 * 1024)
+
+/* Text a non-blocking descriptor would not take yet: buf[sent] to
+ * buf[len] */
+typedef struct held_t {
+    char   *buf;
+    size_t  len;
+    size_t  sent;
+    size_t  cap;
+} held_t;
+
+typedef struct outbuf_t {
+    int     fd;
+    size_t  len;
+    int     error;      /* errno of a failed write, or 0 */
+    held_t *held;       /* where what would block goes, or NULL to wait */
+    char    buf[OUTBUF_LEN];
+} outbuf_t;
+
+void    out_init(outbuf_t *, int fd);
+void    out_hold(outbuf_t *, held_t *);
+void    out_write(outbuf_t *, const char *, size_t);
+void    out_str(outbuf_t *, const char *);
+void    out_char(outbuf_t *, char);
+int     out_flush(outbuf_t *);
+int     out_drain(int fd, held_t *);
+void    held_free(held_t *);
+#endif
@@ -0,0 +1,83 @@
+/*
+ * parse.c
+ *
+ * Turns the VEVENTs of a calendar into events: start and end are parsed
+ * into integer keys once, RRULEs compiled, and summary and location
+ * interned.
+ */
+
+#include "dates.h"
+#include "parse.h"
+#include "rrule.h"
+
+
+/* Function:   extract()
+ * Parameters: reader_t *in - a mapped file, or a piece of one
+ *             arena_t *arena - arena that events and nodes are carved from
+ *             strtab_t *strings - table to intern summaries and locations in
+ * Purpose:    Walks the input one property at a time. The values of the
+ *             current VEVENT are held as views into the mapping and only
+ *             copied into an event once END:VEVENT is reached, which is
+ *             then added onto the end of a doubly-linked list in O(1), so
+ *             that the list is in the order of the file.
+ * Returns:    node_t *head - head of an unsorted list containing all events
+ *             from the input; see sort_list()
+ */
+node_t *extract(reader_t *in, arena_t *arena, strtab_t *strings){
+
+    span_t name, value;
+    span_t dtstart = {0}, dtend = {0}, summary = {0}, location = {0}, rrule = {0};
+    node_t *calendar = NULL, *head = NULL, *tail = NULL;
+
+    while(reader_next(in, &name, &value)){
+        if(span_eq(name, "BEGIN") && span_eq(value, "VEVENT")){
+            dtstart = dtend = summary = location = rrule = (span_t){0};
+        }else if(span_eq(name, "DTSTART")){
+            dtstart = value;
+        }else if(span_eq(name, "DTEND")){
+            dtend = value;
+        }else if(span_eq(name, "SUMMARY")){
+            summary = value;
+        }else if(span_eq(name, "LOCATION")){
+            location = value;
+        }else if(span_eq(name, "RRULE")){
+            rrule = value;
+        }else if(span_eq(name, "END") && span_eq(value, "VEVENT")){
+            calendar = arena_node(arena, new_event(arena, strings, dtstart,
+                                        dtend, summary, location, rrule));
+            if(tail == NULL) head = add_front(head, calendar);
+            else insert_after(tail, calendar);
+            tail = calendar;
+        }
+    }
+    return head;
+}
+
+
+/* Function:   new_event()
+ * Parameters: arena_t *arena - arena to carve the event from
+ *             strtab_t *strings - table to intern summary and location in
+ *             span_t dtstart, dtend - DTSTART and DTEND values
+ *             span_t summary, location - SUMMARY and LOCATION values
+ *             span_t rrule - RRULE value, empty if the event does not repeat
+ * Purpose:    Copies the views gathered for one VEVENT into a new event,
+ *             parsing its start and end into integer keys and compiling
+ *             its rule with rrule_compile() once, so that later
+ *             comparisons never reparse them. The summary and location
+ *             are interned, so the event only holds their ids.
+ * Returns:    event_t *event - the new event
+ */
+event_t *new_event(arena_t *arena, strtab_t *strings, span_t dtstart,
+                   span_t dtend, span_t summary, span_t location,
+                   span_t rrule){
+
+    event_t *event = arena_alloc(arena, sizeof(event_t));
+
+    event->start = parse_datetime(dtstart.ptr, dtstart.len);
+    event->end = parse_datetime(dtend.ptr, dtend.len);
+    event->until = rrule_compile(&event->rule, rrule, event->start);
+    event->summary = strtab_intern(strings, summary.ptr, summary.len);
+    event->location = strtab_intern(strings, location.ptr, location.len);
+    event->block = 0;
+    return event;
+}
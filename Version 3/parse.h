@@ -0,0 +1,12 @@
+#ifndef _PARSE_H_
+#define _PARSE_H_
+
+#include "arena.h"
+#include "ics.h"
+#include "listy.h"
+#include "reader.h"
+#include "strtab.h"
+
+node_t  *extract(reader_t *, arena_t *, strtab_t *);
+event_t *new_event(arena_t *, strtab_t *, span_t, span_t, span_t, span_t, span_t);
+#endif
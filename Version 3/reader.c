@@ -0,0 +1,335 @@
+/*
+ * reader.c
+ *
+ * Zero-copy ICS reader. The file is mapped read-only and each line is
+ * handed back as a (pointer, length) view into the mapping, split at its
+ * first ':' into a property name and value. Nothing is copied until the
+ * caller decides to keep a value. A mapping can also be split into
+ * pieces that start on BEGIN:VEVENT lines, to be read independently.
+ *
+ * Lines are found with bit masks rather than memchr(). Each 64 byte
+ * block of the input is compared against '\n' and ':' once, and the
+ * reader keeps the two masks of its current block; a line's end and
+ * first colon are then the lowest set bits at or after its start, so
+ * the two or three lines of a typical block are found inline by
+ * reader_next() with a few bit operations each. On x86 the masks are
+ * built with AVX2 where the CPU has it and SSE2 otherwise, chosen once
+ * at startup, and elsewhere a byte at a time. The last partial block
+ * of the input is scanned with memchr(), so no load runs past the end
+ * of the mapping.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "reader.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define MASK_SIMD
+#endif
+
+#define NO_COLON     SIZE_MAX
+
+/*
+ * Sets nl and co to the masks of the '\n' and ':' bytes among the
+ * READER_BLOCK bytes at p, bit i for byte i.
+ */
+typedef void (*mask_fn)(const char *p, uint64_t *nl, uint64_t *co);
+
+
+#ifdef MASK_SIMD
+static void mask_sse2(const char *p, uint64_t *nl, uint64_t *co) {
+    const __m128i n = _mm_set1_epi8('\n');
+    const __m128i c = _mm_set1_epi8(':');
+    uint64_t mn = 0, mc = 0;
+    __m128i v;
+    int i;
+
+    for (i = 0; i < READER_BLOCK; i += 16) {
+        v = _mm_loadu_si128((const __m128i *)(p + i));
+        mn |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, n)) << i;
+        mc |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, c)) << i;
+    }
+    *nl = mn;
+    *co = mc;
+}
+
+
+__attribute__((target("avx2")))
+static void mask_avx2(const char *p, uint64_t *nl, uint64_t *co) {
+    const __m256i n = _mm256_set1_epi8('\n');
+    const __m256i c = _mm256_set1_epi8(':');
+    __m256i lo = _mm256_loadu_si256((const __m256i *)p);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+
+    *nl = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, n)) |
+          (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, n)) << 32;
+    *co = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, c)) |
+          (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, c)) << 32;
+}
+
+
+static mask_fn mask_block = mask_sse2;
+
+__attribute__((constructor))
+static void pick_mask(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        mask_block = mask_avx2;
+    }
+}
+#else
+static void mask_scalar(const char *p, uint64_t *nl, uint64_t *co) {
+    uint64_t n = 0, c = 0;
+    int i;
+
+    for (i = 0; i < READER_BLOCK; i++) {
+        n |= (uint64_t)(p[i] == '\n') << i;
+        c |= (uint64_t)(p[i] == ':') << i;
+    }
+    *nl = n;
+    *co = c;
+}
+
+
+static mask_fn mask_block = mask_scalar;
+#endif
+
+
+/*
+ * Makes the block holding offset i the reader's current one, building
+ * its masks unless they are already held. Returns 0 if the block runs
+ * past the end of the input.
+ */
+static inline int load_block(reader_t *r, size_t i) {
+    size_t block = i & ~(size_t)(READER_BLOCK - 1);
+
+    if (r->block_end != 0 && r->block_end - READER_BLOCK == block) {
+        return 1;
+    }
+    if (r->size - block < READER_BLOCK) {
+        return 0;
+    }
+    mask_block(r->base + block, &r->nl, &r->co);
+    r->block_end = block + READER_BLOCK;
+    return 1;
+}
+
+
+/*
+ * Finds the end of the line starting at offset i: returns the offset
+ * of its '\n', or the size of the input if it has none, and stores in
+ * colon the offset of its first ':', or of its end if it has none.
+ */
+static size_t scan_line(reader_t *r, size_t i, size_t *colon) {
+    size_t c = NO_COLON, block, n;
+    uint64_t nl, co;
+    const char *p;
+
+    while (load_block(r, i)) {
+        block = r->block_end - READER_BLOCK;
+        nl = r->nl & (~(uint64_t)0 << (i - block));
+        co = r->co & (~(uint64_t)0 << (i - block));
+        if (nl != 0) {
+            n = block + __builtin_ctzll(nl);
+            co &= (nl & -nl) - 1;
+            if (c == NO_COLON) {
+                c = co != 0 ? block + __builtin_ctzll(co) : n;
+            }
+            *colon = c;
+            return n;
+        }
+        if (c == NO_COLON && co != 0) {
+            c = block + __builtin_ctzll(co);
+        }
+        i = r->block_end;
+    }
+
+    /* The last partial block */
+    p = memchr(r->base + i, '\n', r->size - i);
+    n = p != NULL ? (size_t)(p - r->base) : r->size;
+    if (c == NO_COLON) {
+        p = n > i ? memchr(r->base + i, ':', n - i) : NULL;
+        c = p != NULL ? (size_t)(p - r->base) : n;
+    }
+    *colon = c;
+    return n;
+}
+
+
+int reader_open(reader_t *r, const char *filename) {
+    struct stat sb;
+    void *base;
+    int fd;
+
+    memset(r, 0, sizeof(reader_t));
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode)) {
+        close(fd);
+        return -1;
+    }
+
+    r->size = sb.st_size;
+    if (r->size != 0) {
+        base = mmap(NULL, r->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        madvise(base, r->size, MADV_SEQUENTIAL);
+        r->base = base;
+    }
+    close(fd);
+    return 0;
+}
+
+
+/*
+ * reader_next() for when the line does not end in the current block:
+ * moves on block by block until it does.
+ */
+int reader_scan(reader_t *r, span_t *name, span_t *value) {
+    size_t n, c;
+
+    if (r->pos >= r->size) {
+        return 0;
+    }
+    n = scan_line(r, r->pos, &c);
+    reader_span(r, n, c, name, value);
+    return 1;
+}
+
+
+void reader_close(reader_t *r) {
+    if (r->base != NULL) {
+        munmap((void *)r->base, r->size);
+    }
+    memset(r, 0, sizeof(reader_t));
+}
+
+
+/*
+ * Returns the offset of the first line at or after pos that begins
+ * with BEGIN:VEVENT, or the size of the input if there is none.
+ */
+static size_t next_vevent(const reader_t *r, size_t pos) {
+    static const char tag[] = "BEGIN:VEVENT";
+    const char *p;
+
+    if (pos == 0 && r->size >= sizeof(tag) - 1 &&
+        memcmp(r->base, tag, sizeof(tag) - 1) == 0) {
+        return 0;
+    }
+    p = pos > 0 ? r->base + pos - 1 : r->base;
+    p = memmem(p, r->size - (p - r->base), "\n" "BEGIN:VEVENT", sizeof(tag));
+    return p == NULL ? r->size : (size_t)(p - r->base) + 1;
+}
+
+
+/*
+ * Splits the input into at most max readers over consecutive pieces of
+ * about len bytes, each after the first starting on a BEGIN:VEVENT line
+ * so that no event is cut in two. The pieces share the mapping and must
+ * not be passed to reader_close(). Returns the number of pieces.
+ */
+int reader_split(const reader_t *r, reader_t *parts, size_t len, int max) {
+    size_t begin = 0, end;
+    int n = 0;
+
+    while (begin < r->size && n < max) {
+        if (n + 1 == max || r->size - begin <= len) {
+            end = r->size;
+        } else {
+            end = next_vevent(r, begin + len);
+        }
+        memset(&parts[n], 0, sizeof(reader_t));
+        parts[n].base = r->base + begin;
+        parts[n].size = end - begin;
+        n++;
+        begin = end;
+    }
+    return n;
+}
+
+
+/*
+ * Cuts the next VEVENT off the front of the input into block: from its
+ * BEGIN:VEVENT line to the end of its END:VEVENT line, or up to the
+ * next BEGIN:VEVENT if it has none. Anything between blocks is skipped.
+ * The block shares the mapping. Returns 0 once there are no more.
+ */
+int reader_vevent(reader_t *r, reader_t *block) {
+    static const char tag[] = "\n" "END:VEVENT";
+    size_t begin = next_vevent(r, r->pos);
+    size_t limit, end;
+    const char *p;
+
+    if (begin >= r->size) {
+        r->pos = r->size;
+        return 0;
+    }
+    limit = next_vevent(r, begin + 1);
+    p = memmem(r->base + begin, limit - begin, tag, sizeof(tag) - 1);
+    end = limit;
+    if (p != NULL) {
+        p = memchr(p + 1, '\n', r->base + limit - p - 1);
+        end = p != NULL ? (size_t)(p - r->base) + 1 : limit;
+    }
+    memset(block, 0, sizeof(reader_t));
+    block->base = r->base + begin;
+    block->size = end - begin;
+    r->pos = end;
+    return 1;
+}
+
+
+int span_eq(span_t s, const char *str) {
+    return strlen(str) == s.len && memcmp(s.ptr, str, s.len) == 0;
+}
+
+
+void span_split(span_t s, char c, span_t *before, span_t *after) {
+    const char *at = s.len != 0 ? memchr(s.ptr, c, s.len) : NULL;
+
+    if (at == NULL) {
+        *before = s;
+        after->ptr = s.ptr;
+        after->len = 0;
+        return;
+    }
+    before->ptr = s.ptr;
+    before->len = at - s.ptr;
+    after->ptr  = at + 1;
+    after->len  = s.ptr + s.len - at - 1;
+}
+
+
+/*
+ * Looks up "key" in a ';'-separated list of key=value pairs, as found
+ * in an RRULE, and returns a view of its value (empty if absent).
+ */
+span_t span_param(span_t s, const char *key) {
+    span_t part, rest = s, k, v;
+
+    while (rest.len != 0) {
+        span_split(rest, ';', &part, &rest);
+        span_split(part, '=', &k, &v);
+        if (span_eq(k, key)) {
+            return v;
+        }
+    }
+    rest.ptr = s.ptr;
+    rest.len = 0;
+    return rest;
+}
+
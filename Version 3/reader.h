@@ -0,0 +1,79 @@
+#ifndef _READER_H_
+#define _READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct span_t {
+    const char *ptr;
+    size_t      len;
+} span_t;
+
+#define READER_BLOCK 64
+
+typedef struct reader_t {
+    const char *base;
+    size_t      size;
+    size_t      pos;
+    size_t      block_end;  /* end of the block nl and co are of, or 0 */
+    uint64_t    nl;         /* masks of '\n' and ':' in the block */
+    uint64_t    co;
+} reader_t;
+
+int     reader_open(reader_t *, const char *filename);
+int     reader_scan(reader_t *, span_t *name, span_t *value);
+void    reader_close(reader_t *);
+int     reader_split(const reader_t *, reader_t *parts, size_t len, int max);
+int     reader_vevent(reader_t *, reader_t *block);
+int     span_eq(span_t, const char *);
+void    span_split(span_t, char, span_t *before, span_t *after);
+span_t  span_param(span_t, const char *key);
+
+/*
+ * Hands back the line from pos to the '\n' at offset n, or the end of
+ * the input, split at the ':' at offset c, and moves past it. A '\r'
+ * before the newline is dropped, and a line without a ':' is all name.
+ */
+static inline void reader_span(reader_t *r, size_t n, size_t c,
+                               span_t *name, span_t *value) {
+    const char *line = r->base + r->pos;
+    const char *eol = r->base + n;
+    const char *colon;
+
+    r->pos = n < r->size ? n + 1 : n;
+    if (eol > line && eol[-1] == '\r') {
+        eol--;
+    }
+    colon = r->base + c < eol ? r->base + c : eol;
+    name->ptr  = line;
+    name->len  = colon - line;
+    value->ptr = colon < eol ? colon + 1 : eol;
+    value->len = eol - value->ptr;
+}
+
+/*
+ * Reads the next line as a property name and value, returning 0 at the
+ * end of the input. Defined here so that the common case, a line that
+ * ends in the block whose masks are already held, is inlined into the
+ * parser's loop: its end and colon are the lowest mask bits at or after
+ * its start. Anything else goes to reader_scan().
+ */
+static inline int reader_next(reader_t *r, span_t *name, span_t *value) {
+    size_t block = r->block_end - READER_BLOCK;
+    size_t off = r->pos - block;
+    uint64_t nl, co;
+
+    if (off < READER_BLOCK) {
+        nl = r->nl & (~(uint64_t)0 << off);
+        if (nl != 0) {
+            co = r->co & (~(uint64_t)0 << off) & ((nl & -nl) - 1);
+            reader_span(r, block + __builtin_ctzll(nl),
+                        co != 0 ? block + __builtin_ctzll(co)
+                                : block + __builtin_ctzll(nl),
+                        name, value);
+            return 1;
+        }
+    }
+    return reader_scan(r, name, value);
+}
+#endif
@@ -0,0 +1,83 @@
+/*
+ * report.c
+ *
+ * Writes the events found by a query, in order by start key, as the
+ * readable report: a heading for each day with events, one line per
+ * event, and a blank line between days.
+ */
+
+#include <string.h>
+#include "dates.h"
+#include "report.h"
+
+
+/*
+ * Writes a time of day as "hh:mm AM" in 12 hour time, the hour padded
+ * with a space, into exactly 8 characters at buf.
+ */
+static void format_time(char *buf, int secs) {
+    int hour = secs / 3600;
+    int min = secs / 60 % 60;
+    char period = hour >= 12 ? 'P' : 'A';
+
+    hour %= 12;
+    if (hour == 0) {
+        hour = 12;
+    }
+    buf[0] = hour >= 10 ? '1' : ' ';
+    buf[1] = '0' + hour % 10;
+    buf[2] = ':';
+    buf[3] = '0' + min / 10;
+    buf[4] = '0' + min % 10;
+    buf[5] = ' ';
+    buf[6] = period;
+    buf[7] = 'M';
+}
+
+
+/*
+ * Writes the line of one event: its start and end times, summary and
+ * location.
+ */
+static void report_event(outbuf_t *out, const ics_event_t *e) {
+    char times[22];
+
+    format_time(times, key_secs(e->start));
+    memcpy(times + 8, " to ", 4);
+    format_time(times + 12, key_secs(e->end));
+    memcpy(times + 20, ": ", 2);
+
+    out_write(out, times, sizeof(times));
+    out_str(out, e->summary);
+    out_write(out, " {{", 3);
+    out_str(out, e->location);
+    out_write(out, "}}\n", 3);
+}
+
+
+/*
+ * Writes every event left in the iterator, and returns how many.
+ */
+size_t report(outbuf_t *out, headers_t *headers, ics_iter_t *it) {
+    const header_t *h;
+    ics_event_t e;
+    int32_t day, prev = 0;
+    int first = 1;
+    size_t n = 0;
+
+    while (ics_next(it, &e)) {
+        day = key_day(e.start);
+        if (first || day != prev) {
+            if (!first) {
+                out_char(out, '\n');
+            }
+            h = headers_get(headers, day);
+            out_write(out, h->text, h->len);
+            prev = day;
+            first = 0;
+        }
+        report_event(out, &e);
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,9 @@
+#ifndef _REPORT_H_
+#define _REPORT_H_
+
+#include "headers.h"
+#include "libics.h"
+#include "outbuf.h"
+
+size_t  report(outbuf_t *, headers_t *, ics_iter_t *);
+#endif
@@ -0,0 +1,411 @@
+/*
+ * rrule.c
+ *
+ * Recurrence rules are compiled once, when an event is read, into an
+ * rrule_t: the frequency, the interval and the days each period picks,
+ * held as bit sets. Every rule ends at the latest start a repeat may
+ * have, inclusive: its UNTIL, or the start of the last repeat of its
+ * COUNT, worked out there and then. For daily and weekly rules that is
+ * arithmetic on the days each period picks, and monthly rules, whose
+ * periods differ, are stepped through.
+ *
+ * Rules are then expanded lazily, as generators clipped to the days
+ * being asked for. A period is a day, a week or a month. rrule_seek()
+ * jumps straight to the first period that can hold a day on or after
+ * "from" with arithmetic, and rrule_next() takes the days of a period
+ * as a bit mask and steps forwards until "to" or the rule's end,
+ * whichever comes first. Each step is O(1), so the work done is
+ * proportional to the occurrences yielded, not to the lifetime of the
+ * rule.
+ *
+ * Only the repeats are yielded; the event's own DTSTART is not, though
+ * it counts towards COUNT. YEARLY is read as every twelfth month, a
+ * BYMONTHDAY below -1 is dropped, and parts other than FREQ, INTERVAL,
+ * COUNT, UNTIL, WKST, BYDAY and BYMONTHDAY are ignored.
+ */
+
+#include <string.h>
+#include "dates.h"
+#include "rrule.h"
+
+static const char *day_codes[7] = {
+    "SU", "MO", "TU", "WE", "TH", "FR", "SA"
+};
+
+
+/*
+ * Reads a signed decimal such as "2", "+1" or "-1". Anything else reads
+ * as 0.
+ */
+static int span_int(span_t s) {
+    size_t i = 0;
+    int sign = 1, n = 0;
+
+    if (i < s.len && (s.ptr[i] == '+' || s.ptr[i] == '-')) {
+        sign = s.ptr[i++] == '-' ? -1 : 1;
+    }
+    for (; i < s.len && s.ptr[i] >= '0' && s.ptr[i] <= '9'; i++) {
+        if (n < 1000000) {
+            n = n * 10 + (s.ptr[i] - '0');
+        }
+    }
+    return sign * n;
+}
+
+
+/*
+ * Weekday of a two-letter code such as "MO", or -1.
+ */
+static int day_code(span_t s) {
+    int i;
+
+    for (i = 0; i < 7 && s.len == 2; i++) {
+        if (memcmp(s.ptr, day_codes[i], 2) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ * Months since the start of year 0 of a day, and back to the first day
+ * of such a month.
+ */
+static int32_t month_of(int32_t days) {
+    int year, month, day;
+
+    civil_from_days(days, &year, &month, &day);
+    return year * 12 + month - 1;
+}
+
+static int32_t month_start(int32_t month) {
+    int32_t year = month >= 0 ? month / 12 : (month - 11) / 12;
+
+    return days_from_civil(year, month - year * 12 + 1, 1);
+}
+
+
+/*
+ * Days of a month picked by a monthly rule, bit i for day i + 1. BYDAY
+ * and BYMONTHDAY narrow each other when both are given.
+ */
+static uint32_t month_days(const rrule_t *r, int32_t start, int ndays) {
+    uint32_t by = 0, md;
+    int wd = weekday(start);
+    int w, n, d, i;
+
+    for (w = 0; w < 7; w++) {
+        if (r->byday >> w & 1) {
+            for (d = (w - wd + 7) % 7; d < ndays; d += 7) {
+                by |= 1u << d;
+            }
+        }
+    }
+    for (i = 0; i < RRULE_NTH && r->nth[i] != 0; i++) {
+        w = r->nth[i] & 7;
+        n = (r->nth[i] - w) / 8;
+        d = (w - wd + 7) % 7;
+        d += n > 0 ? 7 * (n - 1) : 7 * ((ndays - 1 - d) / 7 + n + 1);
+        if (d >= 0 && d < ndays) {
+            by |= 1u << d;
+        }
+    }
+    if (r->monthdays != 0) {
+        md = r->monthdays & ((1u << ndays) - 1);
+        if (r->monthdays >> 31) {
+            md |= 1u << (ndays - 1);
+        }
+        by = r->byday != 0 || r->nth[0] != 0 ? by & md : md;
+    }
+    return by;
+}
+
+
+/*
+ * Loads the days the rule picks in the period starting on o->period.
+ */
+static void load_period(occur_t *o) {
+    const rrule_t *r = o->rule;
+    uint32_t week = r->byday;
+
+    switch (r->freq) {
+    case RRULE_DAILY:
+        o->days = r->byday == 0 || (r->byday >> weekday(o->period) & 1);
+        break;
+    case RRULE_WEEKLY:
+        o->days = ((week >> r->wkst) | (week << (7 - r->wkst))) & 0x7f;
+        break;
+    default:
+        o->days = month_days(r, o->period,
+                             month_start(o->month + 1) - o->period);
+        break;
+    }
+}
+
+
+/*
+ * The index, from 1, of the n-th set bit of a mask, or 0 if there are
+ * fewer.
+ */
+static int nth_bit(uint32_t mask, int n) {
+    for (; mask != 0; mask &= mask - 1) {
+        if (--n == 0) {
+            return __builtin_ctz(mask) + 1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Works out the day of the n-th repeat of a daily or weekly rule whose
+ * DTSTART is on day "first", without stepping through those before.
+ * Returns it, first if the rule never repeats, or INT64_MIN for a
+ * monthly rule.
+ */
+static int64_t repeat_day(const rrule_t *r, int32_t first, int64_t n) {
+    int64_t span = 7 * (int64_t)r->interval, k;
+    int32_t start, off, i;
+    uint32_t days, after;
+
+    if (n <= 0) {
+        return first;
+    }
+    switch (r->freq) {
+    case RRULE_DAILY:
+        if (r->byday == 0) {
+            return first + n * r->interval;
+        }
+        /* The weekdays of periods i and i + 7 are the same, so seven
+         * periods in a row always hold as many repeats */
+        for (i = 1, k = 0; i <= 7; i++) {
+            k += r->byday >> weekday(first + i % 7 * r->interval) & 1;
+        }
+        if (k == 0) {
+            return first;
+        }
+        i = 7 * ((n - 1) / k);
+        n -= k * ((n - 1) / k);
+        while (n > 0) {
+            i++;
+            n -= r->byday >> weekday(first + i % 7 * r->interval) & 1;
+        }
+        return first + i * (int64_t)r->interval;
+    case RRULE_WEEKLY:
+        start = first - (weekday(first) - r->wkst + 7) % 7;
+        off = first - start;
+        days = ((r->byday >> r->wkst) | (r->byday << (7 - r->wkst))) & 0x7f;
+        after = days & ~((2u << off) - 1);
+        if (n <= __builtin_popcount(after)) {
+            return start + nth_bit(after, (int)n) - 1;
+        }
+        n -= __builtin_popcount(after);
+        k = __builtin_popcount(days);
+        return start + ((n - 1) / k + 1) * span
+               + nth_bit(days, (int)((n - 1) % k) + 1) - 1;
+    default:
+        return INT64_MIN;
+    }
+}
+
+
+/*
+ * Compiles the value of an RRULE for an event starting at "start".
+ * Returns the latest start a repeat may have, or NO_RRULE if the rule
+ * is not understood and the event should be taken as happening once.
+ * An UNTIL that is a date takes in the whole day. A rule with neither
+ * UNTIL nor COUNT runs for RRULE_HORIZON days.
+ */
+int64_t rrule_compile(rrule_t *r, span_t rule, int64_t start) {
+    span_t freq = span_param(rule, "FREQ");
+    span_t until = span_param(rule, "UNTIL");
+    span_t part, rest;
+    int32_t first = key_day(start);
+    int64_t last, day;
+    int interval = span_int(span_param(rule, "INTERVAL"));
+    int count = span_int(span_param(rule, "COUNT"));
+    int nth = 0, year, month, mday, d, n;
+    event_t event;
+    occur_t o;
+    int64_t at;
+
+    memset(r, 0, sizeof(rrule_t));
+    if (interval < 1) {
+        interval = 1;
+    }
+    if (span_eq(freq, "DAILY")) {
+        r->freq = RRULE_DAILY;
+    } else if (span_eq(freq, "WEEKLY")) {
+        r->freq = RRULE_WEEKLY;
+    } else if (span_eq(freq, "MONTHLY")) {
+        r->freq = RRULE_MONTHLY;
+    } else if (span_eq(freq, "YEARLY")) {
+        r->freq = RRULE_MONTHLY;
+        interval = interval < UINT16_MAX / 12 ? interval * 12 : UINT16_MAX;
+    } else {
+        return NO_RRULE;
+    }
+    r->interval = interval < UINT16_MAX ? interval : UINT16_MAX;
+    d = day_code(span_param(rule, "WKST"));
+    r->wkst = d < 0 ? 1 : d;
+
+    /* "MO" is every Monday of a period; "2MO" and "-1MO" are one
+     * Monday of a month, and read as "MO" in other rules */
+    rest = span_param(rule, "BYDAY");
+    while (rest.len != 0) {
+        span_split(rest, ',', &part, &rest);
+        if (part.len < 2 || (d = day_code((span_t){part.ptr + part.len - 2, 2})) < 0) {
+            continue;
+        }
+        n = span_int((span_t){part.ptr, part.len - 2});
+        if (n == 0 || r->freq != RRULE_MONTHLY) {
+            r->byday |= 1 << d;
+        } else if (n >= -5 && n <= 5 && nth < RRULE_NTH) {
+            r->nth[nth++] = n * 8 + d;
+        }
+    }
+    rest = span_param(rule, "BYMONTHDAY");
+    while (rest.len != 0) {
+        span_split(rest, ',', &part, &rest);
+        n = span_int(part);
+        if (n >= 1 && n <= 31) {
+            r->monthdays |= 1u << (n - 1);
+        } else if (n == -1) {
+            r->monthdays |= 1u << 31;
+        }
+    }
+
+    civil_from_days(first, &year, &month, &mday);
+    if (r->freq == RRULE_WEEKLY && r->byday == 0) {
+        r->byday = 1 << weekday(first);
+    }
+    if (r->freq == RRULE_MONTHLY && r->byday == 0 && nth == 0
+        && r->monthdays == 0) {
+        r->monthdays = 1u << (mday - 1);
+    }
+
+    if (until.len == 0) {
+        last = (int64_t)(first + RRULE_HORIZON) * SECS_PER_DAY
+               + key_secs(start);
+    } else {
+        last = parse_datetime(until.ptr, until.len);
+        if (memchr(until.ptr, 'T', until.len) == NULL) {
+            last += SECS_PER_DAY - 1;
+        }
+    }
+    if (count > 0) {
+        day = repeat_day(r, first, count - 1);
+        if (day != INT64_MIN) {
+            at = day * SECS_PER_DAY + key_secs(start);
+            return at < last ? at : last;
+        }
+        event.start = start;
+        event.until = last;
+        event.rule = *r;
+        rrule_seek(&o, &event, first, key_day(last));
+        for (n = 1, at = start; n < count && rrule_next(&o, &at); n++);
+        if (n == count) {
+            last = at;
+        }
+    }
+    return last;
+}
+
+
+/*
+ * Starts yielding the repeats of an event that fall from "from" to "to",
+ * skipping whole periods before "from" without looking at them.
+ */
+void rrule_seek(occur_t *o, const event_t *event, int from, int to) {
+    const rrule_t *r = &event->rule;
+    int64_t k = 0, span;
+    int32_t start;
+
+    o->rule = r;
+    o->until = event->until;
+    o->first = key_day(event->start);
+    o->secs = key_secs(event->start);
+    o->from = from;
+    o->period = o->first;
+    o->days = 0;
+    if (event->until == NO_RRULE) {
+        o->last = o->first - 1;
+        return;
+    }
+    o->last = key_day(event->until) < to ? key_day(event->until) : to;
+
+    switch (r->freq) {
+    case RRULE_DAILY:
+        if (from > o->first) {
+            k = ((int64_t)from - o->first + r->interval - 1) / r->interval;
+        }
+        o->period = o->first + k * r->interval;
+        break;
+    case RRULE_WEEKLY:
+        span = 7 * (int64_t)r->interval;
+        start = o->first - (weekday(o->first) - r->wkst + 7) % 7;
+        if (from - 6 > start) {
+            k = ((int64_t)from - 6 - start + span - 1) / span;
+        }
+        o->period = start + k * span;
+        break;
+    default:
+        o->month = month_of(o->first);
+        if (from > o->first) {
+            k = ((int64_t)month_of(from) - o->month + r->interval - 1)
+                / r->interval;
+        }
+        o->month += k * r->interval;
+        o->period = month_start(o->month);
+        break;
+    }
+    if (o->period <= o->last) {
+        load_period(o);
+    }
+}
+
+
+/*
+ * Yields the start key of the next repeat, or returns 0 once there are
+ * no more.
+ */
+int rrule_next(occur_t *o, int64_t *start) {
+    const rrule_t *r = o->rule;
+    int32_t day;
+
+    for (;;) {
+        while (o->days == 0) {
+            if (o->period > o->last) {
+                return 0;
+            }
+            if (r->freq == RRULE_DAILY) {
+                o->period += r->interval;
+            } else if (r->freq == RRULE_WEEKLY) {
+                o->period += 7 * r->interval;
+            } else {
+                o->month += r->interval;
+                o->period = month_start(o->month);
+            }
+            if (o->period <= o->last) {
+                load_period(o);
+            }
+        }
+        day = o->period + __builtin_ctz(o->days);
+        o->days &= o->days - 1;
+        if (day > o->last) {
+            o->days = 0;
+            o->last = o->period - 1;
+            return 0;
+        }
+        if (day >= o->from && day > o->first) {
+            *start = (int64_t)day * SECS_PER_DAY + o->secs;
+            if (*start > o->until) {
+                o->days = 0;
+                o->last = o->period - 1;
+                return 0;
+            }
+            return 1;
+        }
+    }
+}
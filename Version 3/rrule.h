@@ -0,0 +1,28 @@
+#ifndef _RRULE_H_
+#define _RRULE_H_
+
+#include <stdint.h>
+#include "ics.h"
+#include "reader.h"
+
+#define RRULE_DAILY     0
+#define RRULE_WEEKLY    1
+#define RRULE_MONTHLY   2
+#define RRULE_HORIZON   36524       /* days a rule with no end runs for */
+
+typedef struct occur_t {
+    const rrule_t *rule;
+    int64_t until;      /* latest start of an occurrence */
+    int32_t secs;       /* time of day of every occurrence */
+    int32_t first;      /* day of the DTSTART, which is not yielded */
+    int32_t from;       /* first day asked for */
+    int32_t last;       /* last day an occurrence may fall on */
+    int32_t period;     /* first day of the current period */
+    int32_t month;      /* months since year 0 of the period, if monthly */
+    uint32_t days;      /* days of the period left, bit i for period + i */
+} occur_t;
+
+int64_t rrule_compile(rrule_t *, span_t, int64_t start);
+void    rrule_seek(occur_t *, const event_t *, int from, int to);
+int     rrule_next(occur_t *, int64_t *start);
+#endif
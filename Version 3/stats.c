@@ -0,0 +1,124 @@
+/*
+ * stats.c
+ *
+ * Timers and counters behind --stats. Each step of a run is timed from
+ * one lap to the next, by the wall clock and by the CPU clock of the
+ * thread doing it. For steps run on several threads the CPU times add
+ * up the work of all of them, while the wall time is how long the step
+ * took as a whole. Nothing here is called unless statistics were
+ * asked for, and the counters are mostly found afterwards from what the
+ * run built rather than kept as it goes, so leaving --stats off costs
+ * a test of a flag per step and the count emalloc() keeps of its
+ * blocks.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "stats.h"
+
+static const char *phase_names[STAT_PHASES] = {
+    "read", "parse", "expand", "sort", "index", "filter", "print"
+};
+
+
+void stats_start(stat_clock_t *c) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    c->wall = ts.tv_sec + ts.tv_nsec / 1e9;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    c->cpu = ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*
+ * Charges the time since the clock was last read to a step, and reads
+ * it again for the next.
+ */
+void stats_lap(stats_t *s, int phase, stat_clock_t *c) {
+    stat_clock_t now;
+
+    stats_start(&now);
+    s->wall[phase] += now.wall - c->wall;
+    s->cpu[phase] += now.cpu - c->cpu;
+    *c = now;
+}
+
+
+void stats_add(stats_t *s, const stats_t *more) {
+    int i;
+
+    for (i = 0; i < STAT_PHASES; i++) {
+        s->wall[i] += more->wall[i];
+        s->cpu[i] += more->cpu[i];
+    }
+    s->lines += more->lines;
+    s->bytes += more->bytes;
+    s->vevents += more->vevents;
+    s->generated += more->generated;
+    s->emitted += more->emitted;
+    s->allocations += more->allocations;
+}
+
+
+/*
+ * Counts the lines of some input, a last line without a '\n' included.
+ */
+uint64_t stats_lines(const char *p, size_t len) {
+    const char *end = p + len, *nl;
+    uint64_t n = 0;
+
+    while (p < end) {
+        nl = memchr(p, '\n', end - p);
+        n++;
+        if (nl == NULL) {
+            break;
+        }
+        p = nl + 1;
+    }
+    return n;
+}
+
+
+/*
+ * Writes the statistics as a table, or as one line of JSON, along with
+ * the peak resident size of the process so far.
+ */
+void stats_write(FILE *f, const stats_t *s, int json) {
+    struct rusage ru;
+    long rss = getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss : 0;
+    int i;
+
+    if (json) {
+        fprintf(f, "{\"phases\":[");
+        for (i = 0; i < STAT_PHASES; i++) {
+            fprintf(f, "%s{\"name\":\"%s\",\"wall\":%.6f,\"cpu\":%.6f}",
+                    i ? "," : "", phase_names[i], s->wall[i], s->cpu[i]);
+        }
+        fprintf(f, "],\"lines\":%llu,\"bytes\":%llu,\"vevents\":%llu,"
+                   "\"generated\":%llu,\"emitted\":%llu,"
+                   "\"allocations\":%llu,\"peak_rss_kb\":%ld}\n",
+                (unsigned long long)s->lines, (unsigned long long)s->bytes,
+                (unsigned long long)s->vevents,
+                (unsigned long long)s->generated,
+                (unsigned long long)s->emitted,
+                (unsigned long long)s->allocations, rss);
+        return;
+    }
+
+    fprintf(f, "%-12s %12s %12s\n", "phase", "wall s", "cpu s");
+    for (i = 0; i < STAT_PHASES; i++) {
+        fprintf(f, "%-12s %12.6f %12.6f\n", phase_names[i], s->wall[i],
+                s->cpu[i]);
+    }
+    fprintf(f, "%-12s %12llu\n", "lines", (unsigned long long)s->lines);
+    fprintf(f, "%-12s %12llu\n", "bytes", (unsigned long long)s->bytes);
+    fprintf(f, "%-12s %12llu\n", "vevents", (unsigned long long)s->vevents);
+    fprintf(f, "%-12s %12llu\n", "generated",
+            (unsigned long long)s->generated);
+    fprintf(f, "%-12s %12llu\n", "emitted", (unsigned long long)s->emitted);
+    fprintf(f, "%-12s %12llu\n", "allocations",
+            (unsigned long long)s->allocations);
+    fprintf(f, "%-12s %12ld\n", "peak rss kB", rss);
+}
@@ -0,0 +1,34 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Steps of a run, in the order they happen */
+enum {
+    STAT_READ, STAT_PARSE, STAT_EXPAND, STAT_SORT, STAT_INDEX, STAT_FILTER,
+    STAT_PRINT, STAT_PHASES
+};
+
+typedef struct stat_clock_t {
+    double      wall;
+    double      cpu;       /* of the calling thread */
+} stat_clock_t;
+
+typedef struct stats_t {
+    double      wall[STAT_PHASES];     /* seconds spent in each step */
+    double      cpu[STAT_PHASES];
+    uint64_t    lines;                  /* of the calendars scanned */
+    uint64_t    bytes;
+    uint64_t    vevents;                /* events as read */
+    uint64_t    generated;              /* occurrences added by expansion */
+    uint64_t    emitted;                /* events printed */
+    uint64_t    allocations;            /* blocks asked of malloc() */
+} stats_t;
+
+void    stats_start(stat_clock_t *);
+void    stats_lap(stats_t *, int phase, stat_clock_t *);
+void    stats_add(stats_t *, const stats_t *);
+uint64_t stats_lines(const char *, size_t);
+void    stats_write(FILE *, const stats_t *, int json);
+#endif
@@ -0,0 +1,98 @@
+/*
+ * strtab.c
+ *
+ * String intern table. Each distinct string is stored once and named by
+ * a small id, so that the occurrences of a repeating event, and events
+ * that share a location, share one copy. Ids are handed out densely
+ * from 0 and stay valid until strtab_free().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "emalloc.h"
+#include "strtab.h"
+
+#define MIN_SLOTS 64
+
+
+static uint32_t hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+
+static void grow(strtab_t *tab) {
+    uint32_t nslots = tab->nslots ? tab->nslots * 2 : MIN_SLOTS;
+    uint32_t *slots = emalloc(nslots * sizeof(uint32_t));
+    uint32_t id, at;
+
+    memset(slots, 0, nslots * sizeof(uint32_t));
+    for (id = 0; id < tab->count; id++) {
+        for (at = tab->hashes[id] & (nslots - 1); slots[at] != 0;
+             at = (at + 1) & (nslots - 1));
+        slots[at] = id + 1;
+    }
+    free(tab->slots);
+    tab->slots = slots;
+    tab->nslots = nslots;
+}
+
+
+uint32_t strtab_intern(strtab_t *tab, const char *s, size_t len) {
+    uint32_t h = hash(s, len);
+    uint32_t at, id;
+    char *copy;
+
+    if ((tab->count + 1) * 4 > tab->nslots * 3) {
+        grow(tab);
+    }
+
+    for (at = h & (tab->nslots - 1); tab->slots[at] != 0;
+         at = (at + 1) & (tab->nslots - 1)) {
+        id = tab->slots[at] - 1;
+        if (tab->hashes[id] == h && strncmp(tab->strings[id], s, len) == 0 &&
+            tab->strings[id][len] == '\0') {
+            return id;
+        }
+    }
+
+    if (tab->count == tab->cap) {
+        tab->cap = tab->cap ? tab->cap * 2 : MIN_SLOTS;
+        tab->strings = realloc(tab->strings, tab->cap * sizeof(char *));
+        tab->hashes = realloc(tab->hashes, tab->cap * sizeof(uint32_t));
+        if (tab->strings == NULL || tab->hashes == NULL) {
+            fprintf(stderr, "realloc of %u strings failed\n", tab->cap);
+            exit(1);
+        }
+    }
+
+    copy = arena_alloc(&tab->arena, len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+
+    id = tab->count++;
+    tab->strings[id] = copy;
+    tab->hashes[id] = h;
+    tab->slots[at] = id + 1;
+    return id;
+}
+
+
+const char *strtab_get(const strtab_t *tab, uint32_t id) {
+    return tab->strings[id];
+}
+
+
+void strtab_free(strtab_t *tab) {
+    arena_free(&tab->arena);
+    free(tab->strings);
+    free(tab->hashes);
+    free(tab->slots);
+    memset(tab, 0, sizeof(strtab_t));
+}
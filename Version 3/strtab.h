@@ -0,0 +1,21 @@
+#ifndef _STRTAB_H_
+#define _STRTAB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+typedef struct strtab_t {
+    arena_t      arena;     /* bytes of the strings */
+    const char **strings;   /* id -> string */
+    uint32_t    *hashes;    /* id -> hash of string */
+    uint32_t     count;
+    uint32_t     cap;
+    uint32_t    *slots;     /* open addressing; id + 1, or 0 if empty */
+    uint32_t     nslots;
+} strtab_t;
+
+uint32_t     strtab_intern(strtab_t *, const char *, size_t);
+const char  *strtab_get(const strtab_t *, uint32_t);
+void         strtab_free(strtab_t *);
+#endif
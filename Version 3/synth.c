@@ -0,0 +1,176 @@
+/*
+ * synth.c
+ *
+ * Synthetic calendars for benchmarks. The same synth_t always gives the
+ * same bytes on any platform, since the numbers come from splitmix64
+ * rather than rand().
+ *
+ * Starts fall at random over the days asked for, on quarter hours,
+ * and events last from a quarter of an hour to three hours. A share of
+ * them repeat for "span" days, weekly on the day they start, which every
+ * version reads the same way. With "mixed", a quarter of those repeat
+ * every 1, 2 or 7 days instead, and another quarter monthly with a
+ * COUNT, which only this version understands.
+ */
+
+#include <string.h>
+#include "dates.h"
+#include "synth.h"
+
+#define SYNTH_MAX_TEXT  1024
+
+static const char *rule_days[7] = {
+    "SU", "MO", "TU", "WE", "TH", "FR", "SA"
+};
+
+
+/*
+ * splitmix64: one 64-bit state, and every seed gives a good stream.
+ */
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static long below(uint64_t *state, long n) {
+    return n > 0 ? (long)(next_random(state) % (uint64_t)n) : 0;
+}
+
+
+/*
+ * Fills "text" with "len" characters: "id" and then lower-case words,
+ * so that each value is told apart by its start.
+ */
+static void fill_text(char *text, int len, const char *id, uint64_t *state) {
+    int n, word = 0;
+
+    if (len < 0) {
+        len = 0;
+    }
+    n = snprintf(text, len + 1, "%s", id);
+
+    for (; n < len; n++) {
+        if (word == 0 && n < len - 1) {
+            text[n] = ' ';
+            word = 2 + below(state, 8);
+        } else {
+            text[n] = 'a' + below(state, 26);
+            word--;
+        }
+    }
+    text[len] = '\0';
+}
+
+
+/*
+ * Writes a day and a time of day as "yyyymmddThhmmss".
+ */
+static void format_stamp(char *buf, size_t len, int32_t day, int secs) {
+    int year, month, mday;
+
+    civil_from_days(day, &year, &month, &mday);
+    snprintf(buf, len, "%04d%02d%02dT%02d%02d%02d", year, month, mday,
+             secs / 3600, secs / 60 % 60, secs % 60);
+}
+
+
+void synth_defaults(synth_t *s) {
+    memset(s, 0, sizeof(synth_t));
+    s->seed = 1;
+    s->events = 1000;
+    s->repeat = 20;
+    s->span = 365;
+    s->summary = 32;
+    s->location = 16;
+    s->first = days_from_civil(2020, 1, 1);
+    s->days = 365;
+}
+
+
+/*
+ * Mean number of occurrences an event of this shape has, counting the
+ * first, so that a caller can size a calendar by occurrences.
+ */
+double synth_mean(const synth_t *s) {
+    double weekly = 1 + s->span / 7;
+    double rules = weekly;
+
+    if (s->mixed) {
+        rules = weekly / 2
+              + (1 + s->span + 1 + s->span / 2 + 1 + s->span / 7) / 12.0
+              + (1 + s->span / 30) / 4.0;
+    }
+    return 1 + (rules - 1) * s->repeat / 100.0;
+}
+
+
+/*
+ * Writes the calendar and returns the number of occurrences in it, as
+ * Version 3 expands them.
+ */
+long synth_write(FILE *out, const synth_t *s) {
+    static const int every[3] = {1, 2, 7};
+    uint64_t state = s->seed;
+    char summary[SYNTH_MAX_TEXT + 1], location[SYNTH_MAX_TEXT + 1];
+    char id[32], start[48], end[48], until[48];
+    long occurrences = 0, i;
+    int32_t day;
+    int secs, length, kind, step, count, year, month, mday;
+
+    fprintf(out, "BEGIN:VCALENDAR\nVERSION:2.0\n");
+    for (i = 0; i < s->events; i++) {
+        day = s->first + below(&state, s->days);
+        secs = below(&state, 96) * 900;
+        length = (1 + below(&state, 12)) * 900;
+        kind = below(&state, 100) < s->repeat ? 1 + below(&state, 4) : 0;
+        if (kind != 0 && !s->mixed) {
+            kind = 1;
+        }
+
+        fprintf(out, "BEGIN:VEVENT\n");
+        if (kind == 4) {
+            /* BYMONTHDAY defaults to the day of DTSTART; keep it in
+             * every month so that the COUNT is met */
+            civil_from_days(day, &year, &month, &mday);
+            if (mday > 28) {
+                day -= mday - 28;
+            }
+        }
+        format_stamp(start, sizeof(start), day, secs);
+        format_stamp(end, sizeof(end), day + (secs + length) / SECS_PER_DAY,
+                     (secs + length) % SECS_PER_DAY);
+        format_stamp(until, sizeof(until), day + s->span, SECS_PER_DAY - 1);
+        fprintf(out, "DTSTART:%s\nDTEND:%s\n", start, end);
+        if (kind == 1 || kind == 2) {
+            fprintf(out, "RRULE:FREQ=WEEKLY;WKST=MO;UNTIL=%s;BYDAY=%s\n",
+                    until, rule_days[weekday(day)]);
+            occurrences += 1 + s->span / 7;
+        } else if (kind == 3) {
+            step = every[below(&state, 3)];
+            fprintf(out, "RRULE:FREQ=DAILY;INTERVAL=%d;UNTIL=%s\n", step,
+                    until);
+            occurrences += 1 + s->span / step;
+        } else if (kind == 4) {
+            count = 1 + s->span / 30;
+            fprintf(out, "RRULE:FREQ=MONTHLY;COUNT=%d\n", count);
+            occurrences += count;
+        } else {
+            occurrences++;
+        }
+        snprintf(id, sizeof(id), "E%ld", i);
+        fill_text(summary, s->summary < SYNTH_MAX_TEXT ? s->summary
+                                                       : SYNTH_MAX_TEXT,
+                  id, &state);
+        snprintf(id, sizeof(id), "L%ld", below(&state, 1000));
+        fill_text(location, s->location < SYNTH_MAX_TEXT ? s->location
+                                                         : SYNTH_MAX_TEXT,
+                  id, &state);
+        fprintf(out, "SUMMARY:%s\nLOCATION:%s\nEND:VEVENT\n", summary,
+                location);
+    }
+    fprintf(out, "END:VCALENDAR\n");
+    return occurrences;
+}
@@ -0,0 +1,23 @@
+#ifndef _SYNTH_H_
+#define _SYNTH_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Shape of a synthetic calendar; see synth.c */
+typedef struct synth_t {
+    uint64_t    seed;
+    long        events;
+    int         repeat;         /* percent of events that repeat */
+    int         span;           /* days a repeating event runs for */
+    int         summary;        /* length of each SUMMARY */
+    int         location;       /* length of each LOCATION */
+    int32_t     first;          /* first day an event may start on */
+    int         days;           /* days the starts are spread over */
+    int         mixed;          /* DAILY and MONTHLY rules as well as WEEKLY */
+} synth_t;
+
+void    synth_defaults(synth_t *);
+double  synth_mean(const synth_t *);
+long    synth_write(FILE *, const synth_t *);
+#endif